@@ -0,0 +1,142 @@
+// Check the unpack routines against the bit at a time extractors
+//
+// Every version the CPU supports is run at every length up to a record
+// and at every start alignment, with the data ending right before an
+// unmapped page so that reading past the end faults.
+
+#include "mfslib.c"
+
+// Words in a record
+#define CHECK_WORDS (RECORD_SZ_IN_CHARS / 4)
+// Start alignments tried; one per byte of a 16 byte load
+#define CHECK_ALIGNS 16
+
+static uint8_t * guard;
+static long pagesz;
+
+// Map enough pages for a record plus slack, then an unmapped page after
+
+static void guardInit (void)
+  {
+    pagesz = sysconf (_SC_PAGESIZE);
+    size_t datasz = (CHECK_WORDS / 2 * 9 + CHECK_ALIGNS + pagesz - 1) / pagesz * pagesz;
+    uint8_t * p = mmap (NULL, datasz + pagesz, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED)
+      {
+        perror ("mmap");
+        abort ();
+      }
+    if (mprotect (p + datasz, pagesz, PROT_NONE))
+      {
+        perror ("mprotect");
+        abort ();
+      }
+    guard = p + datasz;
+    for (size_t i = 0; i < datasz; i ++)
+      p [i] = (uint8_t) (i * 167 + (i >> 3) * 29 + 0x5a);
+  }
+
+// nbytes of data ending slack bytes before the unmapped page
+
+static const uint8_t * guardData (size_t nbytes, size_t slack)
+  {
+    return guard - slack - nbytes;
+  }
+
+typedef void unpack36Proto (const uint8_t * src, word36 * dst, size_t nwords);
+
+static int check36 (const char * name, unpack36Proto * fn)
+  {
+    static word36 got [CHECK_WORDS + 1];
+    int fails = 0;
+    for (size_t n = 0; n <= CHECK_WORDS; n ++)
+      {
+        size_t nbytes = n / 2 * 9 + (n & 1 ? 5 : 0);
+        for (size_t slack = 0; slack < CHECK_ALIGNS; slack ++)
+          {
+            const uint8_t * src = guardData (nbytes, slack);
+            for (size_t i = 0; i <= n; i ++)
+              got [i] = ~ (word36) 0;
+            fn (src, got, n);
+            for (size_t i = 0; i < n; i ++)
+              if (got [i] != extr36 (src, i))
+                {
+                  if (fails ++ < 10)
+                    printf ("unpack36 %s: n %zu slack %zu word %zu %012lo != %012lo\n",
+                            name, n, slack, i, got [i], extr36 (src, i));
+                  break;
+                }
+            if (got [n] != ~ (word36) 0)
+              {
+                if (fails ++ < 10)
+                  printf ("unpack36 %s: n %zu slack %zu wrote past the end\n",
+                          name, n, slack);
+              }
+          }
+      }
+    printf ("unpack36 %s: %s\n", name, fails ? "FAILED" : "ok");
+    return fails;
+  }
+
+typedef void unpack9Proto (const uint8_t * src, uint8_t * dst, size_t nchars);
+
+static int check9 (const char * name, unpack9Proto * fn)
+  {
+    static uint8_t got [RECORD_SZ_IN_CHARS + 1];
+    int fails = 0;
+    for (size_t n = 0; n <= RECORD_SZ_IN_CHARS; n ++)
+      {
+        size_t nbytes = n / 8 * 9 + (n % 8 ? n % 8 + 1 : 0);
+        for (size_t slack = 0; slack < CHECK_ALIGNS; slack ++)
+          {
+            const uint8_t * src = guardData (nbytes, slack);
+            memset (got, 0252, n + 1);
+            fn (src, got, n);
+            for (size_t i = 0; i < n; i ++)
+              if (got [i] != (extr9 (src, i) & 0377))
+                {
+                  if (fails ++ < 10)
+                    printf ("unpack9 %s: n %zu slack %zu char %zu %03o != %03o\n",
+                            name, n, slack, i, got [i], extr9 (src, i) & 0377);
+                  break;
+                }
+            if (got [n] != 0252)
+              {
+                if (fails ++ < 10)
+                  printf ("unpack9 %s: n %zu slack %zu wrote past the end\n",
+                          name, n, slack);
+              }
+          }
+      }
+    printf ("unpack9 %s: %s\n", name, fails ? "FAILED" : "ok");
+    return fails;
+  }
+
+int main (void)
+  {
+    int fails = 0;
+    guardInit ();
+
+    fails += check36 ("scalar", unpack36Scalar);
+#ifdef HAVE_X86_SIMD
+    int level = simdLevel ();
+    if (level >= 1)
+      fails += check36 ("ssse3", unpack36SSSE3);
+    if (level >= 2)
+      fails += check36 ("avx2", unpack36AVX2);
+#endif
+    // And whichever the dispatcher picks
+    fails += check36 ("dispatch", unpack36);
+
+    fails += check9 ("scalar", unpack9Scalar);
+#ifdef HAVE_X86_SIMD
+    if (level >= 1)
+      fails += check9 ("ssse3", unpack9SSSE3);
+    if (level >= 2)
+      fails += check9 ("avx2", unpack9AVX2);
+#endif
+    fails += check9 ("dispatch", unpack9);
+
+    return fails ? 1 : 0;
+  }
@@ -17,6 +17,7 @@
 
 #include <limits.h>
 #include <ctype.h>
+#include <stddef.h>
 #include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
@@ -112,18 +113,13 @@ static time_t m2uTime (word36 mtime)
 
 static int find_uid (struct m_state * m_data, word36 uid)
   {
-    int vtoc_cnt = m_data -> vtoc_cnt;
-    struct vtoc * vtoc = m_data -> vtoc;
-    for (int i = 0; i < vtoc_cnt; i ++)
-      if (vtoc [i] . uid == uid)
-        return i;
-//fprintf (stderr, "find_uid vtoc_cnt %d\n", vtoc_cnt);
+    int i = mx_find_uid (m_data, uid);
 #ifdef DEBUG
-    for (int i = 0; i < vtoc_cnt; i ++)
-      dprintf (stderr, "%5d %012lo\n", i, vtoc [i] . uid);
+    if (i < 0)
+      for (int j = 0; j < m_data -> vtoc_cnt; j ++)
+        dprintf (stderr, "%5d %012lo\n", j, m_data -> vtoc [j] . uid);
 #endif
-
-    return -1;
+    return i;
   }
 
 static int m_readdir (const char * path, void * buf, 
@@ -140,6 +136,7 @@ dprintf (stderr, "m_readdir '%s'\n", path);
         return -1;
       }   
     struct m_state * m_data = M_DATA;
+    mx_load_dir (m_data, ind);
 
 next:;
     struct vtoc * vtocp = m_data -> vtoc + ind;
@@ -214,108 +211,25 @@ dprintf (stderr, "m_readdir returns\n");
 
 static int get_entry (const char * path, int * dindp, int * eindp)
   {
-// find the directory path
-    char s [strlen (path) + 1];
-    strcpy (s, path);
-    char * last = strrchr (s, '/');
-    if (! last)
-      {
-        printf ("m_getattr no path in %s\n", path);
-        return -ENOENT;
-      }
-    if (s == last) // only root
-      strcpy (s, "/");
-    else
-      * last = 0;
-    int dind = mx_lookup_path (M_DATA, s);
-    if (dind < 0)
-      {
-        //printf ("m_getattr can't find [%s] [%s]\n", s, path);
-        return -ENOENT;
-      }
-    if (! (M_DATA -> vtoc [dind] . attr & 0400000))
-      {
-        printf ("m_getattr dir not dir? [%s]\n", path);
-        return -ENOENT;
-      }
-
-// find basename in entries
-
-    char * basename = strrchr (path, '/');
-    if (! basename)
-      {
-        printf ("m_getattr no basename in %s\n", path);
-        return -ENOENT;
-      }
-    basename ++;
-    if (strlen (basename) == 0)
-      {
-        printf ("m_getattr no basename but not dir in %s?\n", path);
-        return -ENOENT;
-      }
-      
-    struct entry * entryp = M_DATA -> vtoc [dind] . entries;
-    int ent_cnt = M_DATA -> vtoc [dind] . ent_cnt;
-    int eind;
-    for (eind = 0; eind < ent_cnt; eind ++)
-      if (strcmp (basename, entryp [eind] . name) == 0)
-        break;
-    if (eind >= ent_cnt)
-      {
-        //printf ("getattr can't find %s in entries\n", basename);
-        return -ENOENT;
-      }
-     
-#if 0
-    int pri_ind = find_uid (M_DATA, entryp [eind] . uid);
-    if (pri_ind < 0)
-      {
-        printf ("find_uid failed; uid %012lo %s\n", entryp [eind] . uid, entryp [eind] . name);
-        printf ("  path %s\n", path);
-        printf ("  eind %d\n", eind);
-        //printf ("  ent_cnt %d\n", vtocp -> ent_cnt);
-        printf ("  type %d\n", entryp [eind] . type);
-
-        return -1;
-      }
-#endif
-    * eindp = eind;
-    * dindp = dind;
-    return entryp [eind] .pri_ind;
+    int ind;
+    if (mx_resolve (M_DATA, path, dindp, eindp, & ind) < 0 || * eindp < 0)
+      return -ENOENT;
+    return M_DATA -> vtoc [* dindp] . entries [* eindp] . pri_ind;
   }
 
 static int m_getattr (const char * path, struct stat * statbuf)
   {
 dprintf (stderr, "m_getattr '%s'\n", path);
     memset (statbuf, 0, sizeof (struct stat));
-// find the directory path
-    char s [strlen (path) + 1];
-    strcpy (s, path);
-    char * last = strrchr (s, '/');
-    if (! last)
-      {
-        printf ("m_getattr no path in %s\n", path);
-        return -ENOENT;
-      }
-    if (s == last) // only root
-      strcpy (s, "/");
-    else
-      * last = 0;
-    int dind = mx_lookup_path (M_DATA, s);
-    if (dind < 0)
+    int dind, eind, ind;
+    if (mx_resolve (M_DATA, path, & dind, & eind, & ind) < 0)
       {
-        //printf ("m_getattr can't find [%s] [%s]\n", s, path);
-        return -ENOENT;
-      }
-    if (! (M_DATA -> vtoc [dind] . attr & 0400000))
-      {
-        printf ("m_getattr dir not dir? [%s]\n", path);
+        //printf ("m_getattr can't find [%s]\n", path);
         return -ENOENT;
       }
 
-    int ind = mx_lookup_path (M_DATA, path);
-    if (ind >= 0 &&
-        M_DATA -> vtoc [ind] . attr & 0400000) // is dir
+    if (eind < 0 ||
+        (ind >= 0 && M_DATA -> vtoc [ind] . attr & 0400000)) // is dir
       {
         statbuf -> st_mtime = m2uTime (M_DATA -> vtoc [ind] . dtm);
         statbuf -> st_atime = m2uTime (M_DATA -> vtoc [ind] . dtu);
@@ -329,35 +243,9 @@ dprintf (stderr, "m_getattr is_dir\n");
 
         return 0;
       }
-//log_msg ("getattr lookup of %s found %s\n", path, M_DATA -> vtoc [ind] . fq_name);
+//log_msg ("getattr lookup of %s found %s\n", path, M_DATA -> vtoc [ind] . name);
 
-// find basename in entries
-
-    char * basename = strrchr (path, '/');
-    if (! basename)
-      {
-        printf ("m_getattr no basename in %s\n", path);
-        return -ENOENT;
-      }
-    basename ++;
-    if (strlen (basename) == 0)
-      {
-        printf ("m_getattr no basename but not dir in %s?\n", path);
-        return -ENOENT;
-      }
-      
     struct entry * entryp = M_DATA -> vtoc [dind] . entries;
-    int ent_cnt = M_DATA -> vtoc [dind] . ent_cnt;
-    int eind;
-    for (eind = 0; eind < ent_cnt; eind ++)
-      if (strcmp (basename, entryp [eind] . name) == 0)
-        break;
-    if (eind >= ent_cnt)
-      {
-        //printf ("getattr can't find %s in entries\n", basename);
-        return -ENOENT;
-      }
-     
     if (entryp [eind] . type == 5) // link
       {
         // XXX link times?
@@ -373,12 +261,12 @@ dprintf (stderr, "m_getattr is_link\n");
         return 0;
       }
 
-    int pri_ind = find_uid (M_DATA, entryp [eind] . uid);
+    int pri_ind = ind;
     if (pri_ind < 0)
       {
         printf ("find_uid failed; uid %012lo %s\n", entryp [eind] . uid, entryp [eind] . name);
         printf ("  path %s\n", path);
-        printf ("  ind %d\n", ind);
+        printf ("  dind %d\n", dind);
         printf ("  eind %d\n", eind);
         //printf ("  ent_cnt %d\n", vtocp -> ent_cnt);
         printf ("  type %d\n", entryp [eind] . type);
@@ -408,6 +296,9 @@ dprintf (stderr, "m_getattr is_link\n");
             statbuf -> st_mode = S_IFREG | 0444;
             statbuf -> st_nlink = 1;
             statbuf -> st_size = (entryp [eind] . bitcnt + 7) / 8;
+            statbuf -> st_blocks = mx_blocks (M_DATA, pri_ind, statbuf -> st_size);
+            if (M_DATA -> text)
+              statbuf -> st_size = entryp [eind] . bitcnt / 9;
           }
       }
 dprintf (stderr, "m_getattr returns\n");
@@ -444,61 +335,17 @@ static void unfixit (char * s)
 
 static int m_readlink (const char * path, char * buf, size_t size)
   {
-// find the directory path
-    char s [strlen (path) + 1];
-    strcpy (s, path);
-    char * last = strrchr (s, '/');
-    if (! last)
-      {
-        printf ("m_readlink no path in %s\n", path);
-        return -ENOENT;
-      }
-    if (s == last) // only root
-      strcpy (s, "/");
-    else
-      * last = 0;
-    int dind = mx_lookup_path (M_DATA, s);
-    if (dind < 0)
-      {
-        printf ("m_readlink can't find [%s] [%s]\n", s, path);
-        return -ENOENT;
-      }
-    if (! (M_DATA -> vtoc [dind] . attr & 0400000))
-      {
-        printf ("m_readlink dir not dir? [%s]\n", path);
-        return -ENOENT;
-      }
-
-// find basename in entries
-
-    char * basename = strrchr (path, '/');
-    if (! basename)
-      {
-        printf ("m_readlink no basename in %s\n", path);
-        return -ENOENT;
-      }
-    basename ++;
-    if (strlen (basename) == 0)
+    int dind, eind, ind;
+    if (mx_resolve (M_DATA, path, & dind, & eind, & ind) < 0 || eind < 0)
       {
-        printf ("m_readlink no basename but not dir in %s?\n", path);
+        printf ("m_readlink can't find [%s]\n", path);
         return -ENOENT;
       }
-      
     struct entry * entryp = M_DATA -> vtoc [dind] . entries;
-    int ent_cnt = M_DATA -> vtoc [dind] . ent_cnt;
-    int eind;
-    for (eind = 0; eind < ent_cnt; eind ++)
-      if (strcmp (basename, entryp [eind] . name) == 0)
-        break;
-    if (eind >= ent_cnt)
-      {
-        printf ("m_readlink can't find %s in entries\n", basename);
-        return -ENOENT;
-      }
      
     if (entryp [eind] . type != 5) // link
       {
-        printf ("m_readlink %s not link\n", basename);
+        printf ("m_readlink %s not link\n", entryp [eind] . name);
         return -ENOENT;
       }
 
@@ -514,14 +361,41 @@ dprintf (stderr, "m_open %s\n", path);
     int ind = get_entry (path, & dind, & eind);
     if (ind < 0)
       return -ENOENT;
-    fi -> fh = (uint64_t) (M_DATA -> vtoc [dind] . entries + eind);
+    struct m_file * filep = calloc (1, sizeof (struct m_file));
+    if (filep == NULL)
+      return -ENOMEM;
+    filep -> entryp = M_DATA -> vtoc [dind] . entries + eind;
+    pthread_mutex_init (& filep -> lock, NULL);
+    fi -> fh = (uint64_t) filep;
 dprintf (stderr, "m_open ok\n");
     return 0;
   }
  
 static int m_read (const char * path, char * buf, size_t size, off_t offset, struct fuse_file_info * fi)
   {
-    return mx_read (buf, size, offset, (struct entry *) (fi -> fh));
+    return mx_read (buf, size, offset, (struct m_file *) (fi -> fh));
+  }
+
+static int m_release (const char * path, struct fuse_file_info * fi)
+  {
+    (void) path;
+    struct m_file * filep = (struct m_file *) (fi -> fh);
+    pthread_mutex_destroy (& filep -> lock);
+    free (filep);
+    return 0;
+  }
+
+static void * m_init (struct fuse_conn_info * conn)
+  {
+    (void) conn;
+    struct m_state * m_data = M_DATA;
+    mx_start_index (m_data);
+    return m_data;
+  }
+
+static void m_destroy (void * private_data)
+  {
+    mx_unmount ((struct m_state *) private_data);
   }
 
 struct fuse_operations m_oper =
@@ -547,7 +421,7 @@ struct fuse_operations m_oper =
 //    /** Just a placeholder, don't set */ // huh???
 //    .statfs = m_statfs,
 //    .flush = m_flush,
-//    .release = m_release,
+    .release = m_release,
 //    .fsync = m_fsync,
 //    .setxattr = m_setxattr,
 //    .getxattr = m_getxattr,
@@ -557,14 +431,30 @@ struct fuse_operations m_oper =
     .readdir = m_readdir,
 //    .releasedir = m_releasedir,
 //    .fsyncdir = m_fsyncdir,
-//    .init = m_init,
-//    .destroy = m_destroy,
+    .init = m_init,
+    .destroy = m_destroy,
 //    .access = m_access,
 //    .create = m_create,
 //    .ftruncate = m_ftruncate,
 //    .fgetattr = m_fgetattr
   };
 
+#define M_OPT(t, p, v) { t, offsetof (struct m_state, p), v }
+
+static struct fuse_opt m_opts [] =
+  {
+    M_OPT ("cache_mb=%u", cache_mb, 0),
+    M_OPT ("mmap", use_mmap, 1),
+    M_OPT ("readahead=%u", readahead, 0),
+    M_OPT ("uring", use_uring, 1),
+    M_OPT ("direct", direct, 1),
+    M_OPT ("threads=%u", threads, 0),
+    M_OPT ("eager", eager, 1),
+    M_OPT ("noindex", noindex, 1),
+    M_OPT ("text", text, 1),
+    FUSE_OPT_END
+  };
+
 int main (int argc, char * argv [])
   {
     int fuse_stat;
@@ -591,6 +481,8 @@ int main (int argc, char * argv [])
         abort ();
       }
     memset (m_data, 0, sizeof (struct m_state));
+    m_data -> cache_mb = 64;
+    m_data -> readahead = 16;
 
     // Pull the rootdir out of the argument list and save it in my
     // internal data
@@ -599,11 +491,20 @@ int main (int argc, char * argv [])
     argv [argc - 1] = NULL;
     argc --;
 
+    struct fuse_args args = FUSE_ARGS_INIT (argc, argv);
+    if (fuse_opt_parse (& args, m_data, m_opts, NULL) == -1)
+      m_usage ();
+
     //m_data -> logfile = log_open ();
 
-    mx_mount (m_data);
+    if (mx_mount (m_data) < 0)
+      {
+        fprintf (stderr, "Can't mount %s\n", m_data -> dsknam);
+        return 1;
+      }
     umask (0);
-    fuse_stat = fuse_main (argc, argv, & m_oper, m_data);
+    fuse_stat = fuse_main (args . argc, args . argv, & m_oper, m_data);
+    fuse_opt_free_args (& args);
 
     return fuse_stat;
 }
@@ -8,12 +8,13 @@
 // writing, the most current API version is 26
 #define FUSE_USE_VERSION 26
 
-// need this to get pwrite().  I have to use setvbuf() instead of
-// setlinebuf() later in consequence.
-#define _XOPEN_SOURCE 500
+// need this to get pwrite() and posix_madvise().  I have to use
+// setvbuf() instead of setlinebuf() later in consequence.
+#define _XOPEN_SOURCE 600
 
 #include <stdint.h>
 #include <stdio.h>
+#include <pthread.h>
 #include <fuse.h>
 
 typedef uint16_t word9;
@@ -36,35 +37,87 @@ struct entry
     int pri_ind;
   };
 
+// A run of file records stored in consecutive disk records; a file map
+// is kept as the extents of its allocated records
+
+struct extent
+  {
+    uint32_t rec;
+    uint16_t frec;
+    uint16_t nrec;
+  };
+
+// Per open file; fuse_file_info . fh points at one of these
+
+struct m_file
+  {
+    struct entry * entryp;
+    pthread_mutex_t lock;
+// read-ahead state
+    off_t next;
+    int seq;
+    uint ra_next;
+  };
+
 struct m_state
   {
     FILE * logfile;
     char * dsknam;
     int fd;
+// options
+    uint cache_mb;
+    int use_mmap;
+    uint readahead;
+    int use_uring;
+    int direct;
+    uint threads;
+    int eager;
+    int noindex;
+    int text;
     struct vtoc
       {
         word36 uid;   
         char * name;
-        char * dir_name;
-        char * fq_name;
+// path of the containing directory, with its '>'; interned, so shared
+// by every entry in it. The full path is dir then name, but the root's is
+// all in dir (see fqName)
+        char * dir;
         word36 attr;
         time_t dtu;
         time_t dtm;
         time_t time_created;
         int sv;
         int vtoce;
-        int32_t filemap [256];
+// file map, as ext_cnt extents from m_state . extents [ext_os]
+        uint32_t ext_os;
+        uint16_t ext_cnt;
 // directory
         int seg_cnt;
         int dir_cnt;
         int lnk_cnt;
         int ent_cnt;
         struct entry * entries;
+// entry name -> entries index, open addressing; -1 is an empty slot
+        int * ent_hash;
+        uint ent_hmask;
+// set once the entries above are filled in; dir_lock serializes parsing
+        int parsed;
+        pthread_mutex_t dir_lock;
       } * vtoc;
 
     int vtoc_no [3];
     int total_vtoc_no;
     int vtoc_cnt;
+// vtoc [i] . uid, packed densely for the uid index probes
+    word36 * uids;
+    struct extent * extents;
+    uint ext_cnt;
+// uid -> vtoc index, open addressing; -1 is an empty slot
+    int * uid_hash;
+    uint uid_hmask;
+// full path -> vtoc index, same scheme
+    int * path_hash;
+    uint path_hmask;
   };
 
 #define M_DATA ((struct m_state *) fuse_get_context () -> private_data)
@@ -1,18 +1,33 @@
+// O_DIRECT is a GNU extension
+#define _GNU_SOURCE
+
 #include "mfs.h"
 
 #include <stdlib.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <fcntl.h>
 #include <sys/types.h>
 #include <unistd.h>
 #include <ctype.h>
 #include <string.h>
 #include <errno.h>
+#include <pthread.h>
+#include <time.h>
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#endif
+#if defined (__x86_64__) || defined (__i386__)
+#define HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
 
 #include "mfslib.h"
 
 //#define DEBUG
+// Time the mount-time VTOC scan against decoding every VTOCE in full
+//#define TIME_VTOC
 
 #ifdef DEBUG
 #define dprintf fprintf
@@ -221,6 +236,7 @@
 //        
 //        
 //160  16     2 uid_path (0:15) bit (36),                             /* uid pathname of all parents starting after the root */
+#define vtoce_uid_path_os 160
 //        
 //176   8     2 primary_name char (32),                               /* primary name of the segment */
 #define vtoce_primary_name_os 176
@@ -580,6 +596,8 @@
 #define SECTOR_SZ_IN_W36 512
 #define SECTOR_SZ_IN_BYTES ((36 * SECTOR_SZ_IN_W36) / 8)
 #define RECORD_SZ_IN_BYTES (sect_per_rec * SECTOR_SZ_IN_BYTES)
+// 1024 words of 4 9 bit characters
+#define RECORD_SZ_IN_CHARS (4 * 1024)
 
 typedef uint8_t sector [SECTOR_SZ_IN_BYTES];
 typedef uint8_t record [RECORD_SZ_IN_BYTES];
@@ -615,11 +633,11 @@ typedef uint8_t record [RECORD_SZ_IN_BYTES];
 //     extract the word36 at woffset
 //
 
-word36 extr36 (uint8_t * bits, uint woffset)
+word36 extr36 (const uint8_t * bits, uint woffset)
   {
     uint isOdd = woffset % 2;
     uint dwoffset = woffset / 2;
-    uint8_t * p = bits + dwoffset * 9;
+    const uint8_t * p = bits + dwoffset * 9;
 
     uint64_t w;
     if (isOdd)
@@ -679,6 +697,113 @@ void put36 (word36 val, uint8_t * bits, uint woffset)
     // mask shouldn't be neccessary but is robust
   }
 
+//
+//   unpack36
+//     extract nwords word36s starting at word 0 into dst
+//
+//   Each pair of words is 9 bytes. Read as big endian, bytes 0-4 hold
+//   word 0 in the top 36 of their 40 bits, and bytes 4-8 word 1 in the
+//   bottom 36. The SIMD versions shuffle each 9 byte group into two
+//   little endian 64 bit lanes holding those 40 bit values, shift the
+//   even lane right 4 and mask both to 36 bits. They only load 16 bytes
+//   at a time where all 16 are inside the buffer, and leave the tail to
+//   the scalar version. The best version the CPU supports is picked on
+//   first use; make check runs each one against extr36.
+
+static void unpack36Scalar (const uint8_t * src, word36 * dst, size_t nwords)
+  {
+    for (; nwords >= 2; nwords -= 2, src += 9, dst += 2)
+      {
+        uint64_t even = ((uint64_t) src [0] << 32) | ((uint64_t) src [1] << 24) |
+                        ((uint64_t) src [2] << 16) | ((uint64_t) src [3] << 8) | src [4];
+        uint64_t odd  = ((uint64_t) src [4] << 32) | ((uint64_t) src [5] << 24) |
+                        ((uint64_t) src [6] << 16) | ((uint64_t) src [7] << 8) | src [8];
+        dst [0] = even >> 4;
+        dst [1] = odd & 0777777777777ULL;
+      }
+    if (nwords)
+      dst [0] = extr36 (src, 0);
+  }
+
+#ifdef HAVE_X86_SIMD
+__attribute__ ((target ("ssse3")))
+static void unpack36SSSE3 (const uint8_t * src, word36 * dst, size_t nwords)
+  {
+    const __m128i shuf = _mm_setr_epi8 (4, 3, 2, 1, 0, -1, -1, -1,
+                                        8, 7, 6, 5, 4, -1, -1, -1);
+    const __m128i even_mask = _mm_set_epi64x (0, 0777777777777LL);
+    const __m128i odd_mask = _mm_set_epi64x (0777777777777LL, 0);
+    // A group is loaded as 16 bytes, so stop a group short of the end
+    for (; nwords >= 4; nwords -= 2, src += 9, dst += 2)
+      {
+        __m128i x = _mm_shuffle_epi8 (_mm_loadu_si128 ((const __m128i *) src), shuf);
+        __m128i even = _mm_and_si128 (_mm_srli_epi64 (x, 4), even_mask);
+        __m128i odd = _mm_and_si128 (x, odd_mask);
+        _mm_storeu_si128 ((__m128i *) dst, _mm_or_si128 (even, odd));
+      }
+    unpack36Scalar (src, dst, nwords);
+  }
+
+__attribute__ ((target ("avx2")))
+static void unpack36AVX2 (const uint8_t * src, word36 * dst, size_t nwords)
+  {
+    const __m256i shuf = _mm256_setr_epi8 (4, 3, 2, 1, 0, -1, -1, -1,
+                                           8, 7, 6, 5, 4, -1, -1, -1,
+                                           4, 3, 2, 1, 0, -1, -1, -1,
+                                           8, 7, 6, 5, 4, -1, -1, -1);
+    const __m256i shifts = _mm256_setr_epi64x (4, 0, 4, 0);
+    const __m256i mask = _mm256_set1_epi64x (0777777777777LL);
+    // Two groups per 256 bit register, one per 128 bit lane; the second
+    // group's load runs 7 bytes past it
+    for (; nwords >= 6; nwords -= 4, src += 18, dst += 4)
+      {
+        __m256i x = _mm256_inserti128_si256 (
+                      _mm256_castsi128_si256 (_mm_loadu_si128 ((const __m128i *) src)),
+                      _mm_loadu_si128 ((const __m128i *) (src + 9)), 1);
+        x = _mm256_shuffle_epi8 (x, shuf);
+        x = _mm256_and_si256 (_mm256_srlv_epi64 (x, shifts), mask);
+        _mm256_storeu_si256 ((__m256i *) dst, x);
+      }
+    unpack36Scalar (src, dst, nwords);
+  }
+#endif
+
+// 2 AVX2, 1 SSSE3, 0 neither
+
+static int simdLevel (void)
+  {
+#ifdef HAVE_X86_SIMD
+    __builtin_cpu_init ();
+    if (__builtin_cpu_supports ("avx2"))
+      return 2;
+    if (__builtin_cpu_supports ("ssse3"))
+      return 1;
+#endif
+    return 0;
+  }
+
+static void unpack36Select (const uint8_t * src, word36 * dst, size_t nwords);
+static void (* unpack36Fn) (const uint8_t * src, word36 * dst, size_t nwords) = unpack36Select;
+
+static void unpack36Select (const uint8_t * src, word36 * dst, size_t nwords)
+  {
+    void (* fn) (const uint8_t * src, word36 * dst, size_t nwords) = unpack36Scalar;
+#ifdef HAVE_X86_SIMD
+    int level = simdLevel ();
+    if (level == 2)
+      fn = unpack36AVX2;
+    else if (level == 1)
+      fn = unpack36SSSE3;
+#endif
+    __atomic_store_n (& unpack36Fn, fn, __ATOMIC_RELAXED);
+    fn (src, dst, nwords);
+  }
+
+void unpack36 (const uint8_t * bits, word36 * dst, size_t nwords)
+  {
+    __atomic_load_n (& unpack36Fn, __ATOMIC_RELAXED) (bits, dst, nwords);
+  }
+
 //
 //   extr9
 //     extract the word9 at coffset
@@ -688,11 +813,11 @@ void put36 (word36 val, uint8_t * bits, uint woffset)
 //     012345670   123456701  234567012   345670123   456701234   567012345   670123456   701234567  
 //
 
-word9 extr9 (uint8_t * bits, uint coffset)
+word9 extr9 (const uint8_t * bits, uint coffset)
   {
     uint charNum = coffset % 8;
     uint dwoffset = coffset / 8;
-    uint8_t * p = bits + dwoffset * 9;
+    const uint8_t * p = bits + dwoffset * 9;
 
     word9 w;
     switch (charNum)
@@ -726,6 +851,108 @@ word9 extr9 (uint8_t * bits, uint coffset)
     return w & 0777U;
   }
 
+//
+//   unpack9
+//     turn nchars 9 bit characters starting at character 0 into the
+//     bytes holding their low 8 bits
+//
+//   Character k of a 9 byte group is the low 9 bits of the big endian
+//   16 bit value (p [k] << 8 | p [k + 1]) >> (7 - k), so its low 8 bits
+//   are the top byte of that value shifted left k + 1. The SIMD versions
+//   shuffle each group into 8 such 16 bit lanes, multiply lane k by
+//   2 ** (k + 1), shift right 8 and pack two groups into 16 bytes. As
+//   with unpack36 they only load whole 16 bytes inside the buffer, leave
+//   the tail to the scalar version, and the best one is picked on first
+//   use; make check runs each one against extr9.
+
+static void unpack9Scalar (const uint8_t * src, uint8_t * dst, size_t nchars)
+  {
+    for (; nchars >= 8; nchars -= 8, src += 9, dst += 8)
+      for (int k = 0; k < 8; k ++)
+        dst [k] = (uint8_t) ((src [k] << (k + 1)) | (src [k + 1] >> (7 - k)));
+    for (uint k = 0; k < nchars; k ++)
+      dst [k] = extr9 (src, k) & 0377;
+  }
+
+#ifdef HAVE_X86_SIMD
+__attribute__ ((target ("ssse3")))
+static void unpack9SSSE3 (const uint8_t * src, uint8_t * dst, size_t nchars)
+  {
+    const __m128i shuf = _mm_setr_epi8 (1, 0, 2, 1, 3, 2, 4, 3, 5, 4, 6, 5, 7, 6, 8, 7);
+    const __m128i mul = _mm_setr_epi16 (2, 4, 8, 16, 32, 64, 128, 256);
+    // The second group's load runs 7 bytes past it
+    for (; nchars >= 24; nchars -= 16, src += 18, dst += 16)
+      {
+        __m128i a = _mm_shuffle_epi8 (_mm_loadu_si128 ((const __m128i *) src), shuf);
+        __m128i b = _mm_shuffle_epi8 (_mm_loadu_si128 ((const __m128i *) (src + 9)), shuf);
+        a = _mm_srli_epi16 (_mm_mullo_epi16 (a, mul), 8);
+        b = _mm_srli_epi16 (_mm_mullo_epi16 (b, mul), 8);
+        _mm_storeu_si128 ((__m128i *) dst, _mm_packus_epi16 (a, b));
+      }
+    unpack9Scalar (src, dst, nchars);
+  }
+
+__attribute__ ((target ("avx2")))
+static __m256i load2x128 (const uint8_t * lo, const uint8_t * hi)
+  {
+    return _mm256_inserti128_si256 (
+             _mm256_castsi128_si256 (_mm_loadu_si128 ((const __m128i *) lo)),
+             _mm_loadu_si128 ((const __m128i *) hi), 1);
+  }
+
+__attribute__ ((target ("avx2")))
+static void unpack9AVX2 (const uint8_t * src, uint8_t * dst, size_t nchars)
+  {
+    const __m256i shuf = _mm256_setr_epi8 (1, 0, 2, 1, 3, 2, 4, 3, 5, 4, 6, 5, 7, 6, 8, 7,
+                                           1, 0, 2, 1, 3, 2, 4, 3, 5, 4, 6, 5, 7, 6, 8, 7);
+    const __m256i mul = _mm256_setr_epi16 (2, 4, 8, 16, 32, 64, 128, 256,
+                                           2, 4, 8, 16, 32, 64, 128, 256);
+    // Four groups a pass. Packing works within 128 bit lanes, so groups
+    // 0 and 2 go in one register and 1 and 3 in the other to come out
+    // in order; the last load runs 7 bytes past group 3
+    for (; nchars >= 40; nchars -= 32, src += 36, dst += 32)
+      {
+        __m256i a = _mm256_shuffle_epi8 (load2x128 (src, src + 18), shuf);
+        __m256i b = _mm256_shuffle_epi8 (load2x128 (src + 9, src + 27), shuf);
+        a = _mm256_srli_epi16 (_mm256_mullo_epi16 (a, mul), 8);
+        b = _mm256_srli_epi16 (_mm256_mullo_epi16 (b, mul), 8);
+        _mm256_storeu_si256 ((__m256i *) dst, _mm256_packus_epi16 (a, b));
+      }
+    unpack9Scalar (src, dst, nchars);
+  }
+#endif
+
+static void unpack9Select (const uint8_t * src, uint8_t * dst, size_t nchars);
+static void (* unpack9Fn) (const uint8_t * src, uint8_t * dst, size_t nchars) = unpack9Select;
+
+static void unpack9Select (const uint8_t * src, uint8_t * dst, size_t nchars)
+  {
+    void (* fn) (const uint8_t * src, uint8_t * dst, size_t nchars) = unpack9Scalar;
+#ifdef HAVE_X86_SIMD
+    int level = simdLevel ();
+    if (level == 2)
+      fn = unpack9AVX2;
+    else if (level == 1)
+      fn = unpack9SSSE3;
+#endif
+    __atomic_store_n (& unpack9Fn, fn, __ATOMIC_RELAXED);
+    fn (src, dst, nchars);
+  }
+
+void unpack9 (const uint8_t * bits, uint8_t * dst, size_t nchars)
+  {
+    __atomic_load_n (& unpack9Fn, __ATOMIC_RELAXED) (bits, dst, nchars);
+  }
+
+// As unpack9, starting at character coffset
+
+static void unpack9At (const uint8_t * bits, uint coffset, uint8_t * dst, size_t nchars)
+  {
+    for (; nchars && coffset % 8; nchars --, coffset ++)
+      * dst ++ = extr9 (bits, coffset) & 0377;
+    unpack9 (bits + coffset / 8 * 9, dst, nchars);
+  }
+
 //
 //   extr18
 //     extract the word18 at coffset
@@ -743,11 +970,11 @@ word9 extr9 (uint8_t * bits, uint coffset)
 //       0  0  1  7  7  4     0  0  7  7  6  0     0  3  7  7  0  0     1  7  7  4  0  0
 //       0  0  0  0  0  3     0  0  0  0  1  7     0  0  0  0  7  7     0  0  0  3  7  7
 
-word18 extr18 (uint8_t * bits, uint boffset)
+word18 extr18 (const uint8_t * bits, uint boffset)
   {
     uint byteNum = boffset % 4;
     uint dwoffset = boffset / 4;
-    uint8_t * p = bits + dwoffset * 18;
+    const uint8_t * p = bits + dwoffset * 18;
 
     word18 w;
     switch (byteNum)
@@ -807,7 +1034,7 @@ uint64_t extr (void * bits, int offset, int nbits)
       {
         n <<= 1;
         n |= getbit (bits, i + offset);
-        dprintf (stderr, "012lo\n", n);
+        dprintf (stderr, "%012lo\n", n);
       }
     return n;
   }
@@ -826,9 +1053,9 @@ static int r2s (int rec, int sv)
     return sect;
   }
 
-static char * str (word36 w)
+#ifdef DEBUG
+static char * str (word36 w, char buf [5])
   {
-    static char buf [5];
     buf [0] = (w >> 27) & 0377;
     buf [1] = (w >> 18) & 0377;
     buf [2] = (w >>  9) & 0377;
@@ -843,245 +1070,2341 @@ static char * str (word36 w)
       }
     return buf;
   }
+#endif
 
-static struct
+// Make characters from unpack9 fit for a file name, as str does
+
+static void fixChars (char * s, size_t n)
+  {
+    for (size_t i = 0; i < n; i ++)
+      {
+        if (s [i] == '/')
+          s [i] = '\\';
+        else if (! isprint ((uint8_t) s [i]))
+          s [i] = '?';
+      }
+  }
+
+// Record cache
+//
+//   The cache is split into one shard per subvolume, each with its own
+//   slots, LRU list and lock, so that FUSE's threads reading from
+//   different subvolumes never contend. Within a shard, records are kept
+//   in a hash table keyed on the record number; the slots are also
+//   threaded on a LRU list, most recently used at the head. A miss
+//   recycles the least recently used slot that is not pinned.
+//
+//   getRecord returns a pointer to the record's bytes in the cache (or
+//   in the mapped image) rather than a copy; the slot stays pinned until
+//   putRecord, so callers can decode straight out of it.
+
+struct cent
   {
     int rec;
     int sv;
+    int pins;
+    struct cent * hnext;
+    struct cent * prev;
+    struct cent * next;
     record data;
-  } cache = { -1, -1, { 1024 * 0 } };
+  };
 
-static void readRecord (int fd, int rec, int sv, record * data)
+struct cshard
   {
-dprintf (stderr, "readRecord 1\n");
-    if (cache . rec == rec && cache . sv == sv)
+    struct cent * slots;
+    struct cent ** hash;
+    uint nslots;
+    uint nused;
+    uint hmask;
+    struct cent lru;
+    pthread_mutex_t lock;
+    unsigned long hits;
+    unsigned long misses;
+  };
+
+static struct cshard cache [number_of_sv];
+
+static uint cacheHash (struct cshard * sh, int rec)
+  {
+    return ((uint) rec * 2654435761u >> 7) & sh -> hmask;
+  }
+
+static void lruUnlink (struct cent * c)
+  {
+    c -> prev -> next = c -> next;
+    c -> next -> prev = c -> prev;
+  }
+
+static void lruPush (struct cshard * sh, struct cent * c)
+  {
+    c -> next = sh -> lru . next;
+    c -> prev = & sh -> lru;
+    sh -> lru . next -> prev = c;
+    sh -> lru . next = c;
+  }
+
+static void cacheInit (size_t bytes)
+  {
+    uint nslots = bytes / number_of_sv / sizeof (struct cent);
+    if (nslots < 16)
+      nslots = 16;
+    uint nhash = 16;
+    while (nhash < nslots)
+      nhash <<= 1;
+
+    for (int sv = 0; sv < number_of_sv; sv ++)
       {
-dprintf (stderr, "readRecord 2\n");
-        memcpy (data, & cache . data, sizeof (record));
-        return;
+        struct cshard * sh = cache + sv;
+        sh -> slots = calloc (nslots, sizeof (struct cent));
+        sh -> hash = calloc (nhash, sizeof (struct cent *));
+        if (sh -> slots == NULL || sh -> hash == NULL)
+          {
+            perror ("cache alloc");
+            abort ();
+          }
+        sh -> nslots = nslots;
+        sh -> hmask = nhash - 1;
+        sh -> lru . next = sh -> lru . prev = & sh -> lru;
+        pthread_mutex_init (& sh -> lock, NULL);
       }
+  }
 
-    int sect = r2s (rec, sv);
-dprintf (stderr, "readRecord lseek rec %d sect %d offset %d\n", rec, sect, sect * SECTOR_SZ_IN_BYTES);
-    off_t n = lseek (fd, sect * SECTOR_SZ_IN_BYTES, SEEK_SET);
-    if (n == (off_t) -1)
-      { fprintf (stderr, "2\n"); exit (1); }
-    ssize_t r = read (fd, & cache . data, sizeof (record));
-    if (r != sizeof (record))
+// Memory mapped image
+//
+//   With -o mmap the whole image is mapped read-only, and records are
+//   addressed directly in the mapping; the page cache stands in for the
+//   record cache.
+
+static struct
+  {
+    uint8_t * base;
+    size_t size;
+  } image;
+
+static int mapImage (int fd)
+  {
+    struct stat st;
+    if (fstat (fd, & st) < 0)
+      return -1;
+    void * p = mmap (NULL, st . st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED)
+      return -1;
+    // Records are scattered across cylinders and interleaved between
+    // subvolumes; kernel read-ahead would mostly fetch the wrong data.
+    posix_madvise (p, st . st_size, POSIX_MADV_RANDOM);
+    image . base = p;
+    image . size = st . st_size;
+    return 0;
+  }
+
+static const uint8_t * mapRecord (int rec, int sv)
+  {
+    size_t os = (size_t) r2s (rec, sv) * SECTOR_SZ_IN_BYTES;
+    if (os + sizeof (record) > image . size)
       { fprintf (stderr, "3\n"); exit (1); }
-    cache . rec = rec;
-    cache . sv = sv;
-    memcpy (data, & cache . data, sizeof (record));
+    return image . base + os;
   }
 
-#define MASK36 0777777777777
-#define MASK24 0000077777777
-#define MASK18 0000000777777
+// Direct I/O
+//
+//   With -o direct the image is opened O_DIRECT, so records are not also
+//   held in the kernel page cache. Transfers then have to be aligned, so
+//   reads go through a small pool of aligned buffers, each big enough for
+//   one subvolume's share of a cylinder, which is the longest run of
+//   contiguous records there can be. The data is copied out of the pool
+//   buffer into the record cache or the caller's buffer.
 
-static word36 vtoc_origin = 8;
-static word36 vtoc_header = 4;
-typedef word36 VTOCE  [512];
+#define DIO_ALIGN 4096
+#define DIO_POOL 8
+#define DIO_BUFSZ (((sect_per_cyl * SECTOR_SZ_IN_BYTES + 2 * DIO_ALIGN) + DIO_ALIGN - 1) & ~(DIO_ALIGN - 1))
 
-static void readVTOCE (int fd, int entNo, int sv, VTOCE * data)
+static struct
   {
-    // 2 VOTCE / record; VTOCE is at 8.
-    int recOff = entNo / 2;
-    int recNum = recOff + 8;
-    record vtocepair;
-    memset (& vtocepair, 0, sizeof (record));
-    readRecord (fd, recNum, sv, & vtocepair);
-    int offset = (entNo & 1) ? 512 : 0;
-    for (int i = 0; i < 512; i ++)
-      (* data) [i] = extr36 (vtocepair, offset + i);
+    int on;
+    uint8_t * free [DIO_POOL];
+    uint nfree;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+  } dio = { 0, { NULL }, 0, PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER };
+
+static void dioInit (void)
+  {
+    for (uint i = 0; i < DIO_POOL; i ++)
+      {
+        void * p;
+        if (posix_memalign (& p, DIO_ALIGN, DIO_BUFSZ) != 0)
+          {
+            perror ("direct I/O pool alloc");
+            abort ();
+          }
+        dio . free [dio . nfree ++] = p;
+      }
+    dio . on = 1;
   }
 
-static void readFileDataRecord (struct m_state * m_data, int ind, uint frecno, record * data)
+static uint8_t * dioGet (void)
   {
-    uint recno = m_data -> vtoc [ind] . filemap [frecno];
-dprintf (stderr, "readFileDataRecord frecno %u recno %u\n", frecno, recno);
-    // High bit on indicates unallocated record
-    if (recno & 0400000)
+    pthread_mutex_lock (& dio . lock);
+    while (dio . nfree == 0)
+      pthread_cond_wait (& dio . cond, & dio . lock);
+    uint8_t * p = dio . free [-- dio . nfree];
+    pthread_mutex_unlock (& dio . lock);
+    return p;
+  }
+
+static void dioPut (uint8_t * p)
+  {
+    pthread_mutex_lock (& dio . lock);
+    dio . free [dio . nfree ++] = p;
+    pthread_cond_signal (& dio . cond);
+    pthread_mutex_unlock (& dio . lock);
+  }
+
+// pread() from the image, going through the pool when the image is open
+// O_DIRECT. Returns len, or -1.
+
+static ssize_t readImage (int fd, uint8_t * buf, size_t len, off_t os)
+  {
+    if (! dio . on)
+      return pread (fd, buf, len, os);
+
+    uint8_t * p = dioGet ();
+    size_t done = 0;
+    while (done < len)
       {
-        memset (data, 0, sizeof (record));
-        return;
+        off_t start = (os + done) & ~(off_t) (DIO_ALIGN - 1);
+        size_t head = os + done - start;
+        size_t chunk = len - done;
+        if (head + chunk > DIO_BUFSZ)
+          chunk = DIO_BUFSZ - head;
+        size_t xfer = (head + chunk + DIO_ALIGN - 1) & ~(size_t) (DIO_ALIGN - 1);
+        // The image need not end on an alignment boundary, so a short
+        // read is fine as long as it covers what was asked for.
+        ssize_t r = pread (fd, p, xfer, start);
+        if (r < (ssize_t) (head + chunk))
+          {
+            dioPut (p);
+            return -1;
+          }
+        memcpy (buf + done, p + head, chunk);
+        done += chunk;
       }
-    readRecord (m_data -> fd, recno, m_data -> vtoc [ind] . sv, data);
+    dioPut (p);
+    return len;
   }
 
-static word36 readFileDataWord36 (struct m_state * m_data, int ind, uint wordno)
+static struct cent * cacheLookup (struct cshard * sh, int rec)
   {
-    // 1204 words/record.
-    uint frecno = wordno / 1024;
-    uint offset = wordno % 1024;
-    record rdata;
-    readFileDataRecord (m_data, ind, frecno, & rdata);
-    return extr36 (rdata, offset);
+    struct cent * c;
+    for (c = sh -> hash [cacheHash (sh, rec)]; c; c = c -> hnext)
+      if (c -> rec == rec)
+        return c;
+    return NULL;
   }
 
-#if 0
-static word72 readFileDataWord72 (struct m_state * m_data, int ind, uint wordno)
+static void cacheUnhash (struct cshard * sh, struct cent * c)
   {
-    // 1204 words/record.
-    uint frecno = wordno / 1024;
-    uint offset = wordno % 1024;
-    record rdata;
-    readFileDataRecord (m_data, ind, frecno, & rdata);
-    word36 even = extr36 (rdata, offset);
-    word36 odd = extr36 (rdata, offset + 1);
-    return ((word72) even << 36) | odd;
+    struct cent ** pp = sh -> hash + cacheHash (sh, c -> rec);
+    while (* pp != c)
+      pp = & (* pp) -> hnext;
+    * pp = c -> hnext;
+    c -> rec = -1;
+    c -> sv = -1;
   }
-#endif
 
-static void unfixit (char * s)
+static void cacheRehash (struct cshard * sh, struct cent * c, int rec, int sv)
   {
-    size_t l = strlen (s);
-    for (size_t i = 0; i < l; i ++)
-      if (s [i] == '>')
-        s [i] = '/';
+    struct cent ** hp = sh -> hash + cacheHash (sh, rec);
+    c -> rec = rec;
+    c -> sv = sv;
+    c -> hnext = * hp;
+    * hp = c;
+    lruUnlink (c);
+    lruPush (sh, c);
   }
 
-static void fixit (char * s)
+// Find a slot to read a record into: an unused one, or the least
+// recently used unpinned one. If every slot is pinned, the caller gets a
+// private slot that putRecord frees.
+
+static struct cent * cacheClaim (struct cshard * sh)
   {
-    size_t l = strlen (s);
-    for (size_t i = 0; i < l; i ++)
-      if (s [i] == '/')
-        s [i] = '>';
+    struct cent * c;
+    if (sh -> nused < sh -> nslots)
+      {
+        c = sh -> slots + sh -> nused ++;
+        c -> rec = -1;
+        c -> sv = -1;
+        lruPush (sh, c);
+        return c;
+      }
+    for (c = sh -> lru . prev; c != & sh -> lru; c = c -> prev)
+      if (c -> pins == 0)
+        {
+          if (c -> rec >= 0)
+            cacheUnhash (sh, c);
+          return c;
+        }
+    c = malloc (sizeof (struct cent));
+    if (c == NULL)
+      {
+        perror ("cache slot alloc");
+        abort ();
+      }
+    c -> rec = -1;
+    c -> sv = -2;
+    c -> prev = c -> next = c;
+    return c;
   }
 
-static void processDirectory (struct m_state * m_data, int ind)
+static void putRecord (struct cent * pin)
   {
-dprintf (stderr, "processDirectory 1 ind %d\n", ind);
-    struct vtoc * vtocp = m_data -> vtoc + ind;
-dprintf (stderr, "processDirectory 1a\n");
-    word36 type_size = readFileDataWord36 (m_data, ind, 1);
-    if (type_size != 0000003000100lu)
+    if (! pin)
+      return;
+    if (pin -> sv == -2)
       {
-dprintf (stderr, "processDirectory 1b\n");
-        fprintf (stderr, "error in dir header type/size for ind %d %012lo\n", ind, type_size);
-        // Seen in mounted disks...
-        if (type_size != 0)
-          return;
+        free (pin);
+        return;
       }
-dprintf (stderr, "processDirectory 1c\n");
-    word36 vtocx_vers = readFileDataWord36 (m_data, ind, 13);
-    if ((vtocx_vers & MASK18) != 2)
+    struct cshard * sh = cache + pin -> sv;
+    pthread_mutex_lock (& sh -> lock);
+    pin -> pins --;
+    pthread_mutex_unlock (& sh -> lock);
+  }
+
+static const uint8_t * getRecord (int fd, int rec, int sv, struct cent ** pin)
+  {
+dprintf (stderr, "getRecord 1\n");
+    if (image . base)
       {
-dprintf (stderr, "processDirectory 1d\n");
-        fprintf (stderr, "error in dir header version for ind %d %012lo\n", ind, vtocx_vers);
-        // Seen in mounted disks...
-        if (vtocx_vers != 0)
-        return;
+        * pin = NULL;
+        return mapRecord (rec, sv);
       }
 
-dprintf (stderr, "processDirectory 2\n");
-    word36 seg_dir_cnt = readFileDataWord36 (m_data, ind, 18);
-    vtocp -> seg_cnt = (seg_dir_cnt >> 18) & MASK18;
-    vtocp -> dir_cnt = seg_dir_cnt & MASK18;
+    struct cshard * sh = cache + sv;
+    pthread_mutex_lock (& sh -> lock);
+    struct cent * c = cacheLookup (sh, rec);
+    if (c)
+      {
+dprintf (stderr, "getRecord 2\n");
+        sh -> hits ++;
+        c -> pins ++;
+        lruUnlink (c);
+        lruPush (sh, c);
+        pthread_mutex_unlock (& sh -> lock);
+        * pin = c;
+        return c -> data;
+      }
+    sh -> misses ++;
+    c = cacheClaim (sh);
+    c -> pins = 1;
+    pthread_mutex_unlock (& sh -> lock);
 
-    word36 lcnt_acle  = readFileDataWord36 (m_data, ind, 19);
-    vtocp -> lnk_cnt = (lcnt_acle >> 18) & MASK18;
+// Read without holding the lock; if another thread fetched the same
+// record meanwhile, use theirs and give the slot back.
 
-    vtocp -> ent_cnt = vtocp -> seg_cnt + vtocp -> dir_cnt + vtocp -> lnk_cnt;
-    vtocp -> entries = calloc (sizeof (struct entry), vtocp -> ent_cnt);
-    if (vtocp -> entries == NULL)
+    int sect = r2s (rec, sv);
+dprintf (stderr, "getRecord pread rec %d sect %d offset %d\n", rec, sect, sect * SECTOR_SZ_IN_BYTES);
+    ssize_t r = readImage (fd, c -> data, sizeof (record), (off_t) sect * SECTOR_SZ_IN_BYTES);
+    if (r != sizeof (record))
+      { fprintf (stderr, "3\n"); exit (1); }
+
+    pthread_mutex_lock (& sh -> lock);
+    struct cent * o = cacheLookup (sh, rec);
+    if (o)
       {
-        perror ("entries alloc");
-        abort ();
+        // Once unlocked, a shared slot may be recycled at any time
+        int priv = c -> sv == -2;
+        o -> pins ++;
+        if (! priv)
+          {
+            c -> pins --;
+            lruUnlink (c);
+            c -> next = & sh -> lru;
+            c -> prev = sh -> lru . prev;
+            sh -> lru . prev -> next = c;
+            sh -> lru . prev = c;
+          }
+        pthread_mutex_unlock (& sh -> lock);
+        if (priv)
+          free (c);
+        * pin = o;
+        return o -> data;
       }
+    if (c -> sv != -2)
+      cacheRehash (sh, c, rec, sv);
+    pthread_mutex_unlock (& sh -> lock);
+    * pin = c;
+    return c -> data;
+  }
 
-dprintf (stderr, "processDirectory 3\n");
-    word36 entryfrpw = readFileDataWord36 (m_data, ind, 14);
-    int entryfrp = (entryfrpw >> 18) & MASK18;
+// Read a run of physically contiguous records straight into the caller's
+// buffer, bypassing the record cache; skip is the byte offset into the
+// first record.
 
-    //word36 entrybrp = readFileDataWord36 (m_data, ind, 15);
-    //entrybrp = (entrybrp >> 18) & MASK18;
+static void readSpan (int fd, int sect, size_t skip, uint8_t * buf, size_t len)
+  {
+    off_t os = (off_t) sect * SECTOR_SZ_IN_BYTES + skip;
+    if (image . base)
+      {
+        if ((size_t) os + len > image . size)
+          { fprintf (stderr, "3\n"); exit (1); }
+        memcpy (buf, image . base + os, len);
+        return;
+      }
+dprintf (stderr, "readSpan pread sect %d skip %lu len %lu\n", sect, skip, len);
+    ssize_t r = readImage (fd, buf, len, os);
+    if (r != (ssize_t) len)
+      { fprintf (stderr, "3\n"); exit (1); }
+  }
 
-    int entry_cnt = 0;
-    for (int entryp = entryfrp; entryp; )
+static int cacheResident (int rec, int sv)
+  {
+    if (image . base)
+      return 0;
+    struct cshard * sh = cache + sv;
+    pthread_mutex_lock (& sh -> lock);
+    int found = cacheLookup (sh, rec) != NULL;
+    pthread_mutex_unlock (& sh -> lock);
+    return found;
+  }
+
+// Copy a record into the cache, unless it is already there.
+
+static void cacheStore (int rec, int sv, const uint8_t * data)
+  {
+    struct cshard * sh = cache + sv;
+    pthread_mutex_lock (& sh -> lock);
+    if (cacheLookup (sh, rec))
       {
-dprintf (stderr, "processDirectory 4 entryp %d\n", entryp);
-        word36 rp = readFileDataWord36 (m_data, ind, entryp);
-        word18 efrp = (rp >> 18) & MASK18;
-        //word18 ebrp = rp & MASK18;
+        pthread_mutex_unlock (& sh -> lock);
+        return;
+      }
+    struct cent * c = cacheClaim (sh);
+    if (c -> sv == -2)
+      {
+        pthread_mutex_unlock (& sh -> lock);
+        free (c);
+        return;
+      }
+    memcpy (c -> data, data, sizeof (record));
+    cacheRehash (sh, c, rec, sv);
+    pthread_mutex_unlock (& sh -> lock);
+  }
 
-        word36 type_size = readFileDataWord36 (m_data, ind, entryp + 1);
-        word18 type = (type_size >> 18) & MASK18;
-        if (type == 0)
-          {
-            goto next;
-          }
+// Read-ahead
+//
+//   Once a file is being read sequentially, mx_read queues the runs of
+//   records ahead of the reader, and a worker thread reads them into the
+//   record cache. The worker is started on first use, since fuse_main
+//   forks after mount. Read-ahead is only a hint: requests that don't
+//   fit in the queue are dropped.
 
-dprintf (stderr, "processDirectory 5\n");
-        word36 uid = readFileDataWord36 (m_data, ind, entryp + 2);
-        
-        if (entry_cnt >= vtocp -> ent_cnt)
+#define RA_QUEUE 64
+
+static struct
+  {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    pthread_once_t once;
+    int fd;
+    struct
+      {
+        int rec;
+        int sv;
+        uint nrec;
+      } q [RA_QUEUE];
+    uint head;
+    uint tail;
+  } ra = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, PTHREAD_ONCE_INIT, -1, { { 0, 0, 0 } }, 0, 0 };
+
+static void * raWorker (void * arg)
+  {
+    (void) arg;
+    uint8_t * buf = NULL;
+    uint bufrecs = 0;
+    for (;;)
+      {
+        pthread_mutex_lock (& ra . lock);
+        while (ra . head == ra . tail)
+          pthread_cond_wait (& ra . cond, & ra . lock);
+        int rec = ra . q [ra . tail % RA_QUEUE] . rec;
+        int sv = ra . q [ra . tail % RA_QUEUE] . sv;
+        uint nrec = ra . q [ra . tail % RA_QUEUE] . nrec;
+        int fd = ra . fd;
+        ra . tail ++;
+        pthread_mutex_unlock (& ra . lock);
+
+        if (nrec > bufrecs)
           {
-            printf ("entries overflow\n");
-            abort ();
+            free (buf);
+            buf = malloc (nrec * sizeof (record));
+            if (buf == NULL)
+              {
+                perror ("read-ahead buffer alloc");
+                abort ();
+              }
+            bufrecs = nrec;
           }
+        readSpan (fd, r2s (rec, sv), 0, buf, nrec * sizeof (record));
+        for (uint i = 0; i < nrec; i ++)
+          cacheStore (rec + i, sv, buf + i * sizeof (record));
+      }
+    return NULL;
+  }
 
-dprintf (stderr, "processDirectory 6\n");
+static void raStart (void)
+  {
+    pthread_t tid;
+    if (pthread_create (& tid, NULL, raWorker, NULL) != 0)
+      {
+        perror ("read-ahead thread");
+        abort ();
+      }
+    pthread_detach (tid);
+  }
 
-        char name [33 + 100];
-        name [0] = 0;
-        for (int j = 0; j < 8; j ++)
-//  entry include file says that the name starts at offset 8, but data dumps indicate offset 12
-          strcat (name, str (readFileDataWord36 (m_data, ind, entryp + 8 + 4 + j)));
-        for (int j = strlen (name) - 1; j >= 0; j --)
-          if (name [j] == ' ')
-            name [j] = 0;
-          else
-            break;
-dprintf (stderr, "processDirectory 6 type: %d uid: %012lo name: '%s'\n", type, uid, name);
-// 4 directory
+static void raQueue (int fd, int rec, int sv, uint nrec)
+  {
+    if (image . base)
+      {
+        off_t os = (off_t) r2s (rec, sv) * SECTOR_SZ_IN_BYTES;
+        off_t pg = os & ~(off_t) (sysconf (_SC_PAGESIZE) - 1);
+        posix_madvise (image . base + pg, os - pg + nrec * sizeof (record),
+                       POSIX_MADV_WILLNEED);
+        return;
+      }
+    pthread_once (& ra . once, raStart);
+    pthread_mutex_lock (& ra . lock);
+    if (ra . head - ra . tail < RA_QUEUE)
+      {
+        ra . fd = fd;
+        ra . q [ra . head % RA_QUEUE] . rec = rec;
+        ra . q [ra . head % RA_QUEUE] . sv = sv;
+        ra . q [ra . head % RA_QUEUE] . nrec = nrec;
+        ra . head ++;
+        pthread_cond_signal (& ra . cond);
+      }
+    pthread_mutex_unlock (& ra . lock);
+  }
+
+// Batched fetch
+//
+//   mx_mount knows well ahead which records it is going to want: the
+//   whole VTOC of a subvolume, all the records of the next directories
+//   to be walked. fetchRecords brings such a batch into the record cache,
+//   coalescing physically contiguous records into one read. With
+//   -o uring (in a build with liburing) the reads are submitted together
+//   to an io_uring and completed as they arrive; otherwise they are
+//   issued one after another.
+
+struct rref
+  {
+    int rec;
+    int sv;
+  };
+
+struct span
+  {
+    int rec;
+    int sv;
+    uint nrec;
+    uint8_t * buf;
+  };
+
+#define URING_DEPTH 64
+
+#ifdef HAVE_LIBURING
+static struct io_uring ring;
+static int ring_ok;
+static pthread_mutex_t ring_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void uringRead (int fd, struct span * spans, uint nspans)
+  {
+    pthread_mutex_lock (& ring_lock);
+    uint next = 0;
+    uint inflight = 0;
+    while (next < nspans || inflight)
+      {
+        while (next < nspans && inflight < URING_DEPTH)
+          {
+            struct io_uring_sqe * sqe = io_uring_get_sqe (& ring);
+            if (! sqe)
+              break;
+            struct span * sp = spans + next ++;
+            io_uring_prep_read (sqe, fd, sp -> buf, sp -> nrec * sizeof (record),
+                                (off_t) r2s (sp -> rec, sp -> sv) * SECTOR_SZ_IN_BYTES);
+            io_uring_sqe_set_data (sqe, sp);
+            inflight ++;
+          }
+        io_uring_submit (& ring);
+        struct io_uring_cqe * cqe;
+        if (io_uring_wait_cqe (& ring, & cqe) < 0)
+          { fprintf (stderr, "3\n"); exit (1); }
+        struct span * sp = io_uring_cqe_get_data (cqe);
+        if (cqe -> res != (int) (sp -> nrec * sizeof (record)))
+          { fprintf (stderr, "3\n"); exit (1); }
+        io_uring_cqe_seen (& ring, cqe);
+        inflight --;
+      }
+    pthread_mutex_unlock (& ring_lock);
+  }
+#endif
+
+// The most records a batch may bring in without evicting itself. Each
+// stored record goes to the LRU head, so a batch of up to half the
+// slots is still all cached when its caller comes to read it.
+
+static uint batchLimit (void)
+  {
+    if (image . base)
+      return 4096;
+    return cache [0] . nslots / 2;
+  }
+
+static void fetchRecords (int fd, const struct rref * refs, uint n)
+  {
+    if (n > batchLimit ())
+      n = batchLimit ();
+
+    struct span * spans = malloc (n * sizeof (struct span));
+    uint8_t * buf = image . base ? NULL : malloc (n * sizeof (record));
+    if (spans == NULL || (buf == NULL && ! image . base))
+      {
+        perror ("fetch alloc");
+        abort ();
+      }
+
+    uint nspans = 0;
+    uint nrecs = 0;
+    for (uint i = 0; i < n; i ++)
+      {
+        if (cacheResident (refs [i] . rec, refs [i] . sv))
+          continue;
+        if (nspans)
+          {
+            struct span * sp = spans + nspans - 1;
+            if (sp -> sv == refs [i] . sv &&
+                r2s (refs [i] . rec, refs [i] . sv) ==
+                  r2s (sp -> rec, sp -> sv) + (int) sp -> nrec * sect_per_rec)
+              {
+                sp -> nrec ++;
+                nrecs ++;
+                continue;
+              }
+          }
+        spans [nspans] . rec = refs [i] . rec;
+        spans [nspans] . sv = refs [i] . sv;
+        spans [nspans] . nrec = 1;
+        spans [nspans] . buf = buf ? buf + nrecs * sizeof (record) : NULL;
+        nspans ++;
+        nrecs ++;
+      }
+dprintf (stderr, "fetchRecords %u records, %u spans\n", nrecs, nspans);
+
+    if (image . base)
+      {
+        for (uint i = 0; i < nspans; i ++)
+          raQueue (fd, spans [i] . rec, spans [i] . sv, spans [i] . nrec);
+        free (spans);
+        return;
+      }
+
+#ifdef HAVE_LIBURING
+    if (ring_ok)
+      uringRead (fd, spans, nspans);
+    else
+#endif
+    for (uint i = 0; i < nspans; i ++)
+      readSpan (fd, r2s (spans [i] . rec, spans [i] . sv), 0, spans [i] . buf,
+                spans [i] . nrec * sizeof (record));
+
+    for (uint i = 0; i < nspans; i ++)
+      for (uint j = 0; j < spans [i] . nrec; j ++)
+        cacheStore (spans [i] . rec + j, spans [i] . sv, spans [i] . buf + j * sizeof (record));
+    free (spans);
+    free (buf);
+  }
+
+#define MASK36 0777777777777
+#define MASK24 0000077777777
+#define MASK18 0000000777777
+
+static word36 vtoc_origin = 8;
+static word36 vtoc_header = 4;
+typedef word36 VTOCE  [512];
+
+#ifdef TIME_VTOC
+static void readVTOCE (int fd, int entNo, int sv, VTOCE * data)
+  {
+    // 2 VOTCE / record; VTOCE is at 8.
+    int recOff = entNo / 2;
+    int recNum = recOff + 8;
+    struct cent * pin;
+    const uint8_t * vtocepair = getRecord (fd, recNum, sv, & pin);
+    // 512 words are 256 9 byte pairs
+    unpack36 (vtocepair + ((entNo & 1) ? 256 * 9 : 0), * data, 512);
+    putRecord (pin);
+  }
+#endif
+
+// File maps
+//
+//   A VTOCE's file map is 256 record numbers, most of them unallocated or
+//   running on from the one before. Each is kept as the extents of its
+//   allocated records, in file record order, in one array shared by all
+//   VTOCEs; this keeps the per VTOCE table small.
+
+struct extbuf
+  {
+    struct extent * p;
+    uint cnt;
+    uint cap;
+  };
+
+static void extPut (struct extbuf * eb, uint first, uint rec, uint frec)
+  {
+    if (eb -> cnt > first)
+      {
+        struct extent * e = eb -> p + eb -> cnt - 1;
+        if (e -> frec + e -> nrec == frec && e -> rec + e -> nrec == rec)
+          {
+            e -> nrec ++;
+            return;
+          }
+      }
+    if (eb -> cnt == eb -> cap)
+      {
+        eb -> cap = eb -> cap ? eb -> cap * 2 : 256;
+        eb -> p = realloc (eb -> p, eb -> cap * sizeof (struct extent));
+        if (eb -> p == NULL)
+          {
+            perror ("extent alloc");
+            abort ();
+          }
+      }
+    eb -> p [eb -> cnt] . rec = rec;
+    eb -> p [eb -> cnt] . frec = frec;
+    eb -> p [eb -> cnt] . nrec = 1;
+    eb -> cnt ++;
+  }
+
+// Disk record holding record frecno of the file; with the high bit on
+// (as in the VTOCE file map) if it is unallocated
+
+static uint fmRecord (struct m_state * m_data, struct vtoc * vtocp, uint frecno)
+  {
+    const struct extent * e = m_data -> extents + vtocp -> ext_os;
+    uint lo = 0, hi = vtocp -> ext_cnt;
+    while (lo < hi)
+      {
+        uint mid = (lo + hi) / 2;
+        if (e [mid] . frec <= frecno)
+          lo = mid + 1;
+        else
+          hi = mid;
+      }
+    if (lo && frecno < (uint) e [lo - 1] . frec + e [lo - 1] . nrec)
+      return e [lo - 1] . rec + (frecno - e [lo - 1] . frec);
+    return 0400000;
+  }
+
+static const record zero_record;
+
+// Unallocated records read as zeroes and are not pinned.
+
+static const uint8_t * getFileDataRecord (struct m_state * m_data, int ind, uint frecno, struct cent ** pin)
+  {
+    uint recno = fmRecord (m_data, m_data -> vtoc + ind, frecno);
+dprintf (stderr, "getFileDataRecord frecno %u recno %u\n", frecno, recno);
+    // High bit on indicates unallocated record
+    if (recno & 0400000)
+      {
+        * pin = NULL;
+        return zero_record;
+      }
+    return getRecord (m_data -> fd, recno, m_data -> vtoc [ind] . sv, pin);
+  }
+
+// A file cursor keeps the file record last used pinned, and unpacks its
+// words in one go, so that walking a directory reads words straight
+// out of an array and characters straight out of the cache.
+
+struct fcursor
+  {
+    struct m_state * m_data;
+    int ind;
+    int frecno;
+    const uint8_t * data;
+    struct cent * pin;
+    word36 words [1024];
+  };
+
+static void fcOpen (struct fcursor * fc, struct m_state * m_data, int ind)
+  {
+    fc -> m_data = m_data;
+    fc -> ind = ind;
+    fc -> frecno = -1;
+    fc -> data = NULL;
+    fc -> pin = NULL;
+  }
+
+static void fcClose (struct fcursor * fc)
+  {
+    putRecord (fc -> pin);
+    fc -> pin = NULL;
+    fc -> frecno = -1;
+  }
+
+static void fcSeek (struct fcursor * fc, int frecno)
+  {
+    if (frecno != fc -> frecno)
+      {
+        fcClose (fc);
+        fc -> data = getFileDataRecord (fc -> m_data, fc -> ind, frecno, & fc -> pin);
+        unpack36 (fc -> data, fc -> words, 1024);
+        fc -> frecno = frecno;
+      }
+  }
+
+static word36 fcWord36 (struct fcursor * fc, uint wordno)
+  {
+    // 1204 words/record.
+    fcSeek (fc, wordno / 1024);
+    return fc -> words [wordno % 1024];
+  }
+
+// nchars characters starting at word wordno, as unpack9 leaves them
+
+static void fcChars (struct fcursor * fc, uint wordno, char * dst, uint nchars)
+  {
+    uint cno = wordno * 4;
+    while (nchars)
+      {
+        fcSeek (fc, cno / RECORD_SZ_IN_CHARS);
+        uint co = cno % RECORD_SZ_IN_CHARS;
+        uint n = RECORD_SZ_IN_CHARS - co < nchars ? RECORD_SZ_IN_CHARS - co : nchars;
+        unpack9At (fc -> data, co, (uint8_t *) dst, n);
+        dst += n;
+        cno += n;
+        nchars -= n;
+      }
+  }
+
+#if 0
+static word72 fcWord72 (struct fcursor * fc, uint wordno)
+  {
+    word36 even = fcWord36 (fc, wordno);
+    word36 odd = fcWord36 (fc, wordno + 1);
+    return ((word72) even << 36) | odd;
+  }
+#endif
+
+static void unfixit (char * s)
+  {
+    size_t l = strlen (s);
+    for (size_t i = 0; i < l; i ++)
+      if (s [i] == '>')
+        s [i] = '/';
+  }
+
+// Arena
+//
+//   The names, directory entries and entry indexes built at mount time
+//   all live until unmount, so rather than malloc each one they are
+//   carved out of 1 MB blocks. arenaFree releases the lot, and saveIndex
+//   writes the blocks out as they stand. Pieces never move once handed
+//   out.
+
+#define ARENA_BLOCK (1u << 20)
+
+struct ablock
+  {
+    struct ablock * next;
+    size_t size;
+    size_t used;
+// where saveIndex put the block in the sidecar
+    uint64_t os;
+    uint8_t data [];
+  };
+
+static struct
+  {
+    pthread_mutex_t lock;
+    struct ablock * head;
+    uint nblocks;
+    size_t used;
+  } arena = { PTHREAD_MUTEX_INITIALIZER, NULL, 0, 0 };
+
+// Zero filled and 8 byte aligned
+
+static void * arenaAlloc (size_t len)
+  {
+    len = (len + 7) & ~(size_t) 7;
+    pthread_mutex_lock (& arena . lock);
+    struct ablock * b = arena . head;
+    if (! b || b -> size - b -> used < len)
+      {
+        size_t size = len > ARENA_BLOCK / 4 ? len : ARENA_BLOCK;
+        b = calloc (1, sizeof (struct ablock) + size);
+        if (b == NULL)
+          {
+            perror ("arena alloc");
+            abort ();
+          }
+        b -> size = size;
+        // An outsize piece gets a block of its own, and the block at the
+        // head goes on being filled
+        if (size != ARENA_BLOCK && arena . head)
+          {
+            b -> next = arena . head -> next;
+            arena . head -> next = b;
+          }
+        else
+          {
+            b -> next = arena . head;
+            arena . head = b;
+          }
+        arena . nblocks ++;
+      }
+    void * p = b -> data + b -> used;
+    b -> used += len;
+    arena . used += len;
+    pthread_mutex_unlock (& arena . lock);
+    return p;
+  }
+
+static char * arenaStr (const char * s, size_t len)
+  {
+    char * p = arenaAlloc (len + 1);
+    memcpy (p, s, len);
+    return p;
+  }
+
+static void arenaFree (void)
+  {
+    pthread_mutex_lock (& arena . lock);
+    while (arena . head)
+      {
+        struct ablock * b = arena . head;
+        arena . head = b -> next;
+        free (b);
+      }
+    arena . nblocks = 0;
+    arena . used = 0;
+    pthread_mutex_unlock (& arena . lock);
+  }
+
+// String interning
+//
+//   Names recur: every directory entry repeats a VTOCE primary name, and
+//   many links share a target. intern returns the one arena copy of a
+//   string, so equal strings share storage; callers must not write to
+//   it. The table is split into shards on the top bits of the hash, each
+//   with its own lock, so the parallel VTOC scan and directory parsing
+//   don't all queue on one mutex.
+
+#define NUM_ISHARDS 16
+
+struct islot
+  {
+    uint h;
+    char * s;
+  };
+
+static struct ishard
+  {
+    pthread_mutex_t lock;
+    struct islot * slots;
+    uint mask;
+    uint cnt;
+  } strtab [NUM_ISHARDS] = { [0 ... NUM_ISHARDS - 1] = { PTHREAD_MUTEX_INITIALIZER, NULL, 0, 0 } };
+
+static uint nameHash (const char * s, uint hmask)
+  {
+    uint h = 2166136261u;
+    for (; * s; s ++)
+      h = (h ^ (uint8_t) * s) * 16777619u;
+    return h & hmask;
+  }
+
+static void internGrow (struct ishard * sh)
+  {
+    uint nslots = sh -> slots ? 2 * (sh -> mask + 1) : 256;
+    struct islot * slots = calloc (nslots, sizeof (struct islot));
+    if (slots == NULL)
+      {
+        perror ("string table alloc");
+        abort ();
+      }
+    for (uint i = 0; sh -> slots && i <= sh -> mask; i ++)
+      if (sh -> slots [i] . s)
+        {
+          uint j = sh -> slots [i] . h & (nslots - 1);
+          while (slots [j] . s)
+            j = (j + 1) & (nslots - 1);
+          slots [j] = sh -> slots [i];
+        }
+    free (sh -> slots);
+    sh -> slots = slots;
+    sh -> mask = nslots - 1;
+  }
+
+static char * intern (const char * s)
+  {
+    uint h = nameHash (s, ~0u);
+    struct ishard * sh = strtab + (h >> 28);
+    pthread_mutex_lock (& sh -> lock);
+    if (! sh -> slots || 2 * (sh -> cnt + 1) > sh -> mask + 1)
+      internGrow (sh);
+    uint i = h & sh -> mask;
+    while (sh -> slots [i] . s)
+      {
+        if (sh -> slots [i] . h == h && strcmp (sh -> slots [i] . s, s) == 0)
+          {
+            pthread_mutex_unlock (& sh -> lock);
+            return sh -> slots [i] . s;
+          }
+        i = (i + 1) & sh -> mask;
+      }
+    sh -> slots [i] . h = h;
+    sh -> slots [i] . s = arenaStr (s, strlen (s));
+    sh -> cnt ++;
+    pthread_mutex_unlock (& sh -> lock);
+    return sh -> slots [i] . s;
+  }
+
+static uint internCount (void)
+  {
+    uint cnt = 0;
+    for (int i = 0; i < NUM_ISHARDS; i ++)
+      {
+        pthread_mutex_lock (& strtab [i] . lock);
+        cnt += strtab [i] . cnt;
+        pthread_mutex_unlock (& strtab [i] . lock);
+      }
+    return cnt;
+  }
+
+static void internFree (void)
+  {
+    for (int i = 0; i < NUM_ISHARDS; i ++)
+      {
+        pthread_mutex_lock (& strtab [i] . lock);
+        free (strtab [i] . slots);
+        strtab [i] . slots = NULL;
+        strtab [i] . mask = 0;
+        strtab [i] . cnt = 0;
+        pthread_mutex_unlock (& strtab [i] . lock);
+      }
+  }
+
+// Paths
+//
+//   A VTOCE doesn't keep its full path, which would repeat its parent's
+//   and so on up to the root. It keeps the path of its directory, dir,
+//   which is interned: every entry of a directory points at the same
+//   copy, so each directory's path is stored once however many entries
+//   it has. The full path is dir followed by name, except that the root's
+//   path is its primary name as recorded, not ">", and is kept whole in
+//   dir.
+
+static const char * pathLeaf (const struct vtoc * vtocp)
+  {
+    return vtocp -> uid == 0777777777777lu ? "" : vtocp -> name;
+  }
+
+static char * fqName (const struct vtoc * vtocp, char buf [4096])
+  {
+    strcpy (buf, vtocp -> dir);
+    strcat (buf, pathLeaf (vtocp));
+    return buf;
+  }
+
+// Directory entry index
+//
+//   Each directory's entries are hashed by name once processDirectory has
+//   filled them in, so finding a basename doesn't mean a scan of every
+//   entry in >system_library_standard.
+
+static void buildEntryIndex (struct vtoc * vtocp, int cnt)
+  {
+    uint nhash = 4;
+    while (nhash < 2 * (uint) cnt)
+      nhash <<= 1;
+    vtocp -> ent_hash = arenaAlloc (nhash * sizeof (int));
+    memset (vtocp -> ent_hash, 0xff, nhash * sizeof (int));
+    vtocp -> ent_hmask = nhash - 1;
+
+    for (int i = 0; i < cnt; i ++)
+      {
+        const char * name = vtocp -> entries [i] . name;
+        uint h = nameHash (name, vtocp -> ent_hmask);
+        // Keep the first of any duplicates, as a scan would
+        while (vtocp -> ent_hash [h] >= 0 &&
+               strcmp (vtocp -> entries [vtocp -> ent_hash [h]] . name, name) != 0)
+          h = (h + 1) & vtocp -> ent_hmask;
+        if (vtocp -> ent_hash [h] < 0)
+          vtocp -> ent_hash [h] = i;
+      }
+  }
+
+// return index into entries; -1 if not found
+
+static int findEntry (struct vtoc * vtocp, const char * name)
+  {
+    if (! vtocp -> ent_hash)
+      return -1;
+    uint h = nameHash (name, vtocp -> ent_hmask);
+    int i;
+    while ((i = vtocp -> ent_hash [h]) >= 0)
+      {
+        if (strcmp (vtocp -> entries [i] . name, name) == 0)
+          return i;
+        h = (h + 1) & vtocp -> ent_hmask;
+      }
+    return -1;
+  }
+
+static void processDirectory (struct m_state * m_data, int ind)
+  {
+dprintf (stderr, "processDirectory 1 ind %d\n", ind);
+    struct vtoc * vtocp = m_data -> vtoc + ind;
+    struct fcursor fc;
+    fcOpen (& fc, m_data, ind);
+dprintf (stderr, "processDirectory 1a\n");
+    word36 type_size = fcWord36 (& fc, 1);
+    if (type_size != 0000003000100lu)
+      {
+dprintf (stderr, "processDirectory 1b\n");
+        fprintf (stderr, "error in dir header type/size for ind %d %012lo\n", ind, type_size);
+        // Seen in mounted disks...
+        if (type_size != 0)
+          {
+            fcClose (& fc);
+            return;
+          }
+      }
+dprintf (stderr, "processDirectory 1c\n");
+    word36 vtocx_vers = fcWord36 (& fc, 13);
+    if ((vtocx_vers & MASK18) != 2)
+      {
+dprintf (stderr, "processDirectory 1d\n");
+        fprintf (stderr, "error in dir header version for ind %d %012lo\n", ind, vtocx_vers);
+        // Seen in mounted disks...
+        if (vtocx_vers != 0)
+          {
+            fcClose (& fc);
+            return;
+          }
+      }
+
+dprintf (stderr, "processDirectory 2\n");
+    word36 seg_dir_cnt = fcWord36 (& fc, 18);
+    vtocp -> seg_cnt = (seg_dir_cnt >> 18) & MASK18;
+    vtocp -> dir_cnt = seg_dir_cnt & MASK18;
+
+    word36 lcnt_acle  = fcWord36 (& fc, 19);
+    vtocp -> lnk_cnt = (lcnt_acle >> 18) & MASK18;
+
+    vtocp -> ent_cnt = vtocp -> seg_cnt + vtocp -> dir_cnt + vtocp -> lnk_cnt;
+    vtocp -> entries = arenaAlloc (vtocp -> ent_cnt * sizeof (struct entry));
+
+dprintf (stderr, "processDirectory 3\n");
+    word36 entryfrpw = fcWord36 (& fc, 14);
+    int entryfrp = (entryfrpw >> 18) & MASK18;
+
+    //word36 entrybrp = fcWord36 (& fc, 15);
+    //entrybrp = (entrybrp >> 18) & MASK18;
+
+    int entry_cnt = 0;
+    for (int entryp = entryfrp; entryp; )
+      {
+dprintf (stderr, "processDirectory 4 entryp %d\n", entryp);
+        word36 rp = fcWord36 (& fc, entryp);
+        word18 efrp = (rp >> 18) & MASK18;
+        //word18 ebrp = rp & MASK18;
+
+        word36 type_size = fcWord36 (& fc, entryp + 1);
+        word18 type = (type_size >> 18) & MASK18;
+        if (type == 0)
+          {
+            goto next;
+          }
+
+dprintf (stderr, "processDirectory 5\n");
+        word36 uid = fcWord36 (& fc, entryp + 2);
+        
+        if (entry_cnt >= vtocp -> ent_cnt)
+          {
+            printf ("entries overflow\n");
+            abort ();
+          }
+
+dprintf (stderr, "processDirectory 6\n");
+
+        char name [33 + 100];
+//  entry include file says that the name starts at offset 8, but data dumps indicate offset 12
+        fcChars (& fc, entryp + 8 + 4, name, 32);
+        fixChars (name, 32);
+        name [32] = 0;
+        for (int j = strlen (name) - 1; j >= 0; j --)
+          if (name [j] == ' ')
+            name [j] = 0;
+          else
+            break;
+dprintf (stderr, "processDirectory 6 type: %d uid: %012lo name: '%s'\n", type, uid, name);
+// 4 directory
 // 5 link
 // 7 segment
         if (type != 7 && type != 4 && type !=5)
           printf ("    %d %s\n", type, name);
 dprintf (stderr, "processDirectory 7\n");
-        vtocp -> entries [entry_cnt] . name = strdup (name);
+        vtocp -> entries [entry_cnt] . name = intern (name);
         vtocp -> entries [entry_cnt] . uid = uid;
         vtocp -> entries [entry_cnt] . type = type;
-        word36 bc = readFileDataWord36 (m_data, ind, entryp + 32);
+        word36 bc = fcWord36 (& fc, entryp + 32);
         vtocp -> entries [entry_cnt] . bitcnt = bc & MASK24;
 
-        if (type == 5) // link
+        if (type == 5) // link
+          {
+dprintf (stderr, "processDirectory 8\n");
+            word18 pathname_size = fcWord36 (& fc, entryp + 24) & MASK18;
+            if (pathname_size > 168)
+              {
+                printf ("pathname_size %u truncated\n", pathname_size);
+                pathname_size = 168;
+              }
+            char pathname [169];
+            fcChars (& fc, entryp + 25, pathname, pathname_size);
+            fixChars (pathname, pathname_size);
+            pathname [pathname_size] = 0;
+            //printf ("[%s]\n", pathname);
+            vtocp -> entries [entry_cnt] . link_target = intern (pathname);
+dprintf (stderr, "processDirectory 8a entry %d path '%s'\n", entry_cnt, pathname);
+          }
+        else
+          {
+dprintf (stderr, "processDirectory 9\n");
+            char path [8192];
+            fqName (vtocp, path);
+            if (strcmp (path, ">") != 0)
+              strcat (path, ">");
+            strcat (path, name);
+            unfixit (path);
+            vtocp -> entries [entry_cnt] . pri_ind = mx_lookup_path (m_data, path);
+dprintf (stderr, "processDirectory 9a entry %d path '%s'\n", entry_cnt, path);
+          }
+        entry_cnt ++;
+next:;
+        entryp = efrp;
+      }
+    fcClose (& fc);
+dprintf (stderr, "processDirectory 10\n");
+    if (entry_cnt != vtocp -> ent_cnt)
+      printf ("entry_cnt %d ent_cnt %d\n", entry_cnt, vtocp -> ent_cnt);
+    // The header can count more entries than the chain holds (seen in
+    // disks not dismounted cleanly); keep only the ones filled in
+    vtocp -> ent_cnt = entry_cnt;
+    buildEntryIndex (vtocp, entry_cnt);
+  }
+
+// UID index
+//
+//   Open addressing with linear probing, sized to at least twice the
+//   number of VTOCEs so probe chains stay short. Built once at mount
+//   time and read-only afterwards, so lookups need no locking. Probes
+//   compare against the dense uids array, not the vtoc table.
+
+static uint uidHash (word36 uid, uint hmask)
+  {
+    uint64_t h = uid * 0x9e3779b97f4a7c15lu;
+    return (uint) (h >> 32) & hmask;
+  }
+
+static void buildUids (struct m_state * m_data)
+  {
+    m_data -> uids = malloc ((m_data -> vtoc_cnt ? m_data -> vtoc_cnt : 1) * sizeof (word36));
+    if (m_data -> uids == NULL)
+      {
+        perror ("uids alloc");
+        abort ();
+      }
+    for (int i = 0; i < m_data -> vtoc_cnt; i ++)
+      m_data -> uids [i] = m_data -> vtoc [i] . uid;
+  }
+
+static void buildUidIndex (struct m_state * m_data)
+  {
+    buildUids (m_data);
+
+    uint nhash = 16;
+    while (nhash < 2 * (uint) m_data -> vtoc_cnt)
+      nhash <<= 1;
+    m_data -> uid_hash = malloc (nhash * sizeof (int));
+    if (m_data -> uid_hash == NULL)
+      {
+        perror ("uid index alloc");
+        abort ();
+      }
+    memset (m_data -> uid_hash, 0xff, nhash * sizeof (int));
+    m_data -> uid_hmask = nhash - 1;
+
+    for (int i = 0; i < m_data -> vtoc_cnt; i ++)
+      {
+        word36 uid = m_data -> uids [i];
+        uint h = uidHash (uid, m_data -> uid_hmask);
+        // On duplicates keep the first, as the old linear scan did
+        while (m_data -> uid_hash [h] >= 0 &&
+               m_data -> uids [m_data -> uid_hash [h]] != uid)
+          h = (h + 1) & m_data -> uid_hmask;
+        if (m_data -> uid_hash [h] < 0)
+          m_data -> uid_hash [h] = i;
+      }
+  }
+
+// return index into vtoc table; -1 if not found
+
+int mx_find_uid (struct m_state * m_data, word36 uid)
+  {
+    if (! m_data -> uid_hash)
+      return -1;
+    uint h = uidHash (uid, m_data -> uid_hmask);
+    int i;
+    while ((i = m_data -> uid_hash [h]) >= 0)
+      {
+        if (m_data -> uids [i] == uid)
+          return i;
+        h = (h + 1) & m_data -> uid_hmask;
+      }
+    return -1;
+  }
+
+// Path index
+//
+//   Keyed on the full path, dir then name. The hash and compare treat
+//   '/' as '>', so a FUSE path, or a leading part of one, can be looked
+//   up as it stands without copying it.
+
+static uint pathHash (const char * s, size_t len, uint hmask)
+  {
+    uint h = 2166136261u;
+    for (size_t i = 0; i < len; i ++)
+      {
+        uint8_t c = s [i] == '/' ? '>' : s [i];
+        h = (h ^ c) * 16777619u;
+      }
+    return h & hmask;
+  }
+
+static int pathEq (const struct vtoc * vtocp, const char * path, size_t len)
+  {
+    const char * part [2] = { vtocp -> dir, pathLeaf (vtocp) };
+    size_t i = 0;
+    for (int k = 0; k < 2; k ++)
+      for (const char * s = part [k]; * s; s ++, i ++)
+        if (i == len || * s != (path [i] == '/' ? '>' : path [i]))
+          return 0;
+    return i == len;
+  }
+
+static void buildPathIndex (struct m_state * m_data)
+  {
+    uint nhash = 16;
+    while (nhash < 2 * (uint) m_data -> vtoc_cnt)
+      nhash <<= 1;
+    m_data -> path_hash = malloc (nhash * sizeof (int));
+    if (m_data -> path_hash == NULL)
+      {
+        perror ("path index alloc");
+        abort ();
+      }
+    memset (m_data -> path_hash, 0xff, nhash * sizeof (int));
+    m_data -> path_hmask = nhash - 1;
+
+    for (int i = 0; i < m_data -> vtoc_cnt; i ++)
+      {
+        char path [4096];
+        size_t len = strlen (fqName (m_data -> vtoc + i, path));
+        uint h = pathHash (path, len, m_data -> path_hmask);
+        while (m_data -> path_hash [h] >= 0 &&
+               ! pathEq (m_data -> vtoc + m_data -> path_hash [h], path, len))
+          h = (h + 1) & m_data -> path_hmask;
+        if (m_data -> path_hash [h] < 0)
+          m_data -> path_hash [h] = i;
+      }
+  }
+
+// Directories are parsed the first time something looks inside them,
+// or all of them at mount time on the mount-time pool with -o eager.
+// Parsing a directory only writes its own vtoc entry and reads the
+// finished name tables, and the record cache does its own locking, so
+// directories can be parsed concurrently; dir_lock stops two threads
+// parsing the same one. The directory's records are fetched in one
+// batch and then walked.
+
+void mx_load_dir (struct m_state * m_data, int ind)
+  {
+    struct vtoc * vtocp = m_data -> vtoc + ind;
+    if (__atomic_load_n (& vtocp -> parsed, __ATOMIC_ACQUIRE))
+      return;
+    pthread_mutex_lock (& vtocp -> dir_lock);
+    if (! vtocp -> parsed)
+      {
+        if (vtocp -> attr & 0400000)
+          {
+            struct rref refs [256];
+            uint n = 0;
+            const struct extent * e = m_data -> extents + vtocp -> ext_os;
+            for (uint x = 0; x < vtocp -> ext_cnt; x ++)
+              for (uint k = 0; k < e [x] . nrec && n < 256; k ++)
+                {
+                  refs [n] . rec = e [x] . rec + k;
+                  refs [n] . sv = vtocp -> sv;
+                  n ++;
+                }
+            fetchRecords (m_data -> fd, refs, n);
+            processDirectory (m_data, ind);
+          }
+        __atomic_store_n (& vtocp -> parsed, 1, __ATOMIC_RELEASE);
+      }
+    pthread_mutex_unlock (& vtocp -> dir_lock);
+  }
+
+struct dscan
+  {
+    struct m_state * m_data;
+    int * dirs;
+    uint ndirs;
+  };
+
+static void scanDirectory (void * arg, uint di)
+  {
+    struct dscan * ds = arg;
+    struct m_state * m_data = ds -> m_data;
+dprintf (stderr, "mx_mount 10\n");
+    mx_load_dir (m_data, ds -> dirs [di]);
+  }
+
+// Ancestor uids of a VTOCE, captured during the VTOC scan so that the
+// names can be built without reading the VTOC again
+
+struct ancestry
+  {
+    word36 uid [16];
+    int cnt;
+  };
+
+// A VTOCE's dir is its parent's full path, plus a '>' unless the
+// parent is the root. The parent's dir is built first, as long as the
+// parent's own uid path is a prefix of ours. Otherwise fall back to
+// assembling the path one ancestor at a time.
+
+static void buildDir (struct m_state * m_data, struct ancestry * anc, int i, const char * root_pname)
+  {
+    struct vtoc * vtocp = m_data -> vtoc + i;
+    if (vtocp -> dir)
+      return;
+
+    char dir [4096];
+    dir [0] = 0;
+    struct ancestry * ap = anc + i;
+    int p = ap -> cnt ? mx_find_uid (m_data, ap -> uid [ap -> cnt - 1]) : -1;
+    if (p >= 0 && anc [p] . cnt == ap -> cnt - 1 &&
+        memcmp (anc [p] . uid, ap -> uid, anc [p] . cnt * sizeof (word36)) == 0)
+      {
+        buildDir (m_data, anc, p, root_pname);
+        fqName (m_data -> vtoc + p, dir);
+        if (ap -> cnt > 1)
+          strcat (dir, ">");
+      }
+    else
+      {
+        for (int j = 0; j < ap -> cnt; j ++)
+          {
+            int k = mx_find_uid (m_data, ap -> uid [j]);
+            if (k >= 0)
+              strcat (dir, m_data -> vtoc [k] . name);
+            else
+              {
+                 char buf [13];
+                 sprintf (buf, "%012lo", ap -> uid [j]);
+                 strcat (dir, buf);
+              }
+            if (j)
+              strcat (dir, ">");
+          }
+      }
+
+    if (vtocp -> uid == 0777777777777lu) // root
+      strcat (dir, root_pname);
+    vtocp -> dir = intern (dir);
+  }
+
+// Mount-time worker pool
+//
+//   runPool calls fn (arg, i) for every i below n on up to nthreads
+//   threads, and returns once all are done. The items are dealt out
+//   as one contiguous range per worker; a worker takes items from the
+//   front of its own range and, when that runs dry, steals the back
+//   half of someone else's. Directory sizes vary wildly, so this keeps
+//   every thread busy without a shared counter to fight over. With one
+//   thread, or one item, it all happens on the calling thread.
+
+struct wsrange
+  {
+    pthread_mutex_t lock;
+    uint lo;
+    uint hi;
+  };
+
+struct pool
+  {
+    uint nthreads;
+    struct wsrange * q;
+    void (* fn) (void * arg, uint i);
+    void * arg;
+  };
+
+struct pworker
+  {
+    struct pool * pl;
+    uint self;
+  };
+
+static int poolTake (struct pool * pl, uint self, uint * ip)
+  {
+    struct wsrange * q = pl -> q + self;
+    pthread_mutex_lock (& q -> lock);
+    if (q -> lo < q -> hi)
+      {
+        * ip = q -> lo ++;
+        pthread_mutex_unlock (& q -> lock);
+        return 1;
+      }
+    pthread_mutex_unlock (& q -> lock);
+
+    for (uint k = 1; k < pl -> nthreads; k ++)
+      {
+        struct wsrange * v = pl -> q + (self + k) % pl -> nthreads;
+        pthread_mutex_lock (& v -> lock);
+        if (v -> lo < v -> hi)
+          {
+            uint hi = v -> hi;
+            uint mid = hi - (hi - v -> lo + 1) / 2;
+            v -> hi = mid;
+            pthread_mutex_unlock (& v -> lock);
+            pthread_mutex_lock (& q -> lock);
+            q -> lo = mid + 1;
+            q -> hi = hi;
+            pthread_mutex_unlock (& q -> lock);
+            * ip = mid;
+            return 1;
+          }
+        pthread_mutex_unlock (& v -> lock);
+      }
+    return 0;
+  }
+
+static void * poolWorker (void * p)
+  {
+    struct pworker * w = p;
+    uint i;
+    while (poolTake (w -> pl, w -> self, & i))
+      w -> pl -> fn (w -> pl -> arg, i);
+    return NULL;
+  }
+
+#define MAX_THREADS 64
+
+static void runPool (uint nthreads, uint n, void (* fn) (void * arg, uint i), void * arg)
+  {
+    if (nthreads > n)
+      nthreads = n;
+    if (nthreads < 1)
+      nthreads = 1;
+    struct wsrange q [nthreads];
+    struct pworker w [nthreads];
+    pthread_t tids [nthreads];
+    struct pool pl = { nthreads, q, fn, arg };
+    for (uint t = 0; t < nthreads; t ++)
+      {
+        pthread_mutex_init (& q [t] . lock, NULL);
+        q [t] . lo = (uint64_t) n * t / nthreads;
+        q [t] . hi = (uint64_t) n * (t + 1) / nthreads;
+        w [t] . pl = & pl;
+        w [t] . self = t;
+      }
+    for (uint t = 1; t < nthreads; t ++)
+      if (pthread_create (tids + t, NULL, poolWorker, w + t))
+        {
+          perror ("pool thread create");
+          abort ();
+        }
+    poolWorker (w);
+    for (uint t = 1; t < nthreads; t ++)
+      pthread_join (tids [t], NULL);
+    for (uint t = 0; t < nthreads; t ++)
+      pthread_mutex_destroy (& q [t] . lock);
+  }
+
+// Decode the VTOCE at word os of a VTOC record into * vtocp, unpacking
+// only the words up to time_created rather than all 512. Free VTOCEs
+// are skipped after looking at the uid.
+//
+// return
+//   1 VTOCE in use
+//   0 free
+
+static int scanVTOCE (struct vtoc * vtocp, const uint8_t * bits, uint os,
+                      int sv, int entNo, struct ancestry * ap, char * root_pname,
+                      struct extbuf * eb)
+  {
+    word36 uid = extr36 (bits, os + 1);
+    if (! uid)
+      return 0;
+    // os is even, so the VTOCE starts on a 9 byte pair; so does the name
+    word36 w [186];
+    unpack36 (bits + os / 2 * 9, w, 186);
+    vtocp -> uid = uid;
+    vtocp -> attr = w [5];
+    vtocp -> dtu = w [3];
+    vtocp -> dtm = w [4];
+    vtocp -> time_created = w [184];
+    vtocp -> sv = sv;
+    vtocp -> vtoce = entNo;
+    vtocp -> ext_os = eb -> cnt;
+    for (uint fmi = 0; fmi < 128; fmi ++)
+      {
+        word18 fm0 = (w [vtoce_fm_os + fmi] >> 18) & MASK18;
+        word18 fm1 = w [vtoce_fm_os + fmi] & MASK18;
+        // High bit on indicates unallocated record
+        if (! (fm0 & 0400000))
+          extPut (eb, vtocp -> ext_os, fm0, fmi * 2);
+        if (! (fm1 & 0400000))
+          extPut (eb, vtocp -> ext_os, fm1, fmi * 2 + 1);
+      }
+    vtocp -> ext_cnt = eb -> cnt - vtocp -> ext_os;
+    for (ap -> cnt = 0; ap -> cnt < 16; ap -> cnt ++)
+      {
+        word36 pw = w [vtoce_uid_path_os + ap -> cnt];
+        if (! pw)
+          break;
+        ap -> uid [ap -> cnt] = pw;
+      }
+
+    char name [33];
+    unpack9 (bits + (os + vtoce_primary_name_os) / 2 * 9, (uint8_t *) name, 32);
+    fixChars (name, 32);
+    name [32] = 0;
+    for (int j = strlen (name) - 1; j >= 0; j --)
+      if (name [j] == ' ')
+        name [j] = 0;
+      else
+        break;
+
+    if (uid == 0777777777777lu) // root
+      {
+        vtocp -> name = intern (">");
+        // The root's path uses the primary name as recorded
+        strcpy (root_pname, name);
+      }
+    else
+      {
+        vtocp -> name = intern (name);
+dprintf (stderr, "mx_mount 6 name: '%s'\n", name);
+      }
+    return 1;
+  }
+
+// The VTOC is cut into chunks of up to one fetch batch of records each.
+// Chunks are scanned in parallel into tables of their own, which are
+// then appended to the vtoc table in chunk order, so it comes out just
+// as a serial scan would have left it.
+
+struct vchunk
+  {
+    int sv;
+    int first;
+    int nent;
+    int cnt;
+    struct vtoc * vtoc;
+    struct ancestry * anc;
+    struct extbuf ext;
+    int has_root;
+    char root_pname [33];
+  };
+
+struct vscan
+  {
+    struct m_state * m_data;
+    struct vchunk * chunks;
+  };
+
+static void scanChunk (void * arg, uint ci)
+  {
+    struct vscan * vs = arg;
+    struct vchunk * ch = vs -> chunks + ci;
+    int fd = vs -> m_data -> fd;
+dprintf (stderr, "mx_mount 6 sv %d first %d\n", ch -> sv, ch -> first);
+
+    ch -> vtoc = calloc (ch -> nent, sizeof (struct vtoc));
+    ch -> anc = malloc (ch -> nent * sizeof (struct ancestry));
+    struct rref * refs = malloc ((ch -> nent + 1) / 2 * sizeof (struct rref));
+    if (ch -> vtoc == NULL || ch -> anc == NULL || refs == NULL)
+      {
+        perror ("vtoc chunk alloc");
+        abort ();
+      }
+
+    uint n = 0;
+    for (int i = 0; i < ch -> nent; i += 2, n ++)
+      {
+        refs [n] . rec = vtoc_origin + (ch -> first + i) / 2;
+        refs [n] . sv = ch -> sv;
+      }
+    fetchRecords (fd, refs, n);
+    free (refs);
+
+    // Both VTOCEs of a record are decoded on one visit
+    for (int i = ch -> first; i < ch -> first + ch -> nent; i += 2)
+      {
+        struct cent * pin;
+        const uint8_t * vtocepair = getRecord (fd, vtoc_origin + i / 2, ch -> sv, & pin);
+        for (int k = i; k < i + 2 && k < ch -> first + ch -> nent; k ++)
+          {
+            struct vtoc * vtocp = ch -> vtoc + ch -> cnt;
+            if (scanVTOCE (vtocp, vtocepair, (k & 1) ? 512 : 0, ch -> sv, k,
+                           ch -> anc + ch -> cnt, ch -> root_pname, & ch -> ext))
+              {
+                if (vtocp -> uid == 0777777777777lu)
+                  ch -> has_root = 1;
+                ch -> cnt ++;
+              }
+          }
+        putRecord (pin);
+      }
+  }
+
+#ifdef TIME_VTOC
+static double elapsed (struct timespec * t0)
+  {
+    struct timespec t1;
+    clock_gettime (CLOCK_MONOTONIC, & t1);
+    return (t1 . tv_sec - t0 -> tv_sec) + (t1 . tv_nsec - t0 -> tv_nsec) / 1e9;
+  }
+
+// With the VTOC records now cached, time a scan pass against the old
+// way, where every VTOCE was decoded in full through readVTOCE and its
+// record looked up once per VTOCE
+
+static void timeVTOCDecode (struct m_state * m_data)
+  {
+    struct m_state scratch = * m_data;
+    struct extbuf ext = { NULL, 0, 0 };
+    scratch . vtoc = calloc (sizeof (struct vtoc), m_data -> total_vtoc_no);
+    struct ancestry * anc = malloc (m_data -> total_vtoc_no * sizeof (struct ancestry));
+    char root_pname [33];
+    if (scratch . vtoc == NULL || anc == NULL)
+      {
+        perror ("timing alloc");
+        abort ();
+      }
+    scratch . vtoc_cnt = 0;
+
+    struct timespec t0;
+    clock_gettime (CLOCK_MONOTONIC, & t0);
+    for (int sv = 0; sv < 3; sv ++)
+      for (int i = 0; i < m_data -> vtoc_no [sv]; i += 2)
+        {
+          struct cent * pin;
+          const uint8_t * vtocepair = getRecord (m_data -> fd, vtoc_origin + i / 2, sv, & pin);
+          for (int k = i; k < i + 2 && k < m_data -> vtoc_no [sv]; k ++)
+            scratch . vtoc_cnt += scanVTOCE (scratch . vtoc + scratch . vtoc_cnt,
+                                             vtocepair, (k & 1) ? 512 : 0, sv, k,
+                                             anc + scratch . vtoc_cnt, root_pname, & ext);
+          putRecord (pin);
+        }
+    double t_scan = elapsed (& t0);
+
+    clock_gettime (CLOCK_MONOTONIC, & t0);
+    unsigned long sum = 0;
+    for (int sv = 0; sv < 3; sv ++)
+      for (int i = 0; i < m_data -> vtoc_no [sv]; i ++)
+        {
+          VTOCE vtoce;
+          readVTOCE (m_data -> fd, i, sv, & vtoce);
+          sum += vtoce [1] != 0;
+        }
+    double t_full = elapsed (& t0);
+
+    fprintf (stderr, "VTOC decode of %d VTOCEs (%lu in use): scan %.6f s, full %.6f s\n",
+             m_data -> total_vtoc_no, sum, t_scan, t_full);
+
+    free (scratch . vtoc);
+    free (anc);
+    free (ext . p);
+  }
+#endif
+
+// Index sidecar
+//
+//   Once every directory has been parsed the tables are saved next to
+//   the image as <image>.mfsidx, and the next mount of the same image
+//   maps that file instead of building them again. The file is the
+//   vtoc table, the uid and path indexes and the file maps, followed by
+//   the arena blocks holding the names and each directory's entries and
+//   name index, laid out as they are in memory with pointers stored as
+//   file offsets. Loading maps it privately and turns the offsets
+//   back into pointers; the strings and hash tables are used in place.
+//
+//   The header records the format version and structure sizes, and is
+//   keyed on the image's size and mtime and on the label's
+//   time_map_updated and time_unmounted words; a sidecar that doesn't
+//   match in every respect is ignored and rewritten. So is one whose
+//   contents don't hold together: an offset out of bounds, a hash table
+//   of the wrong size, with no empty slot, or pointing past its array,
+//   a subvolume or file map extent that can't exist, or an entry without
+//   a name or link target or naming a VTOCE that isn't there.
+
+#define MFSIDX_MAGIC "MFSIDX\n"
+#define MFSIDX_VERSION 4
+
+struct mfsidx_key
+  {
+    uint64_t image_size;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    word36 time_map_upd;
+    word36 time_unmounted;
+  };
+
+struct mfsidx_hdr
+  {
+    char magic [8];
+    uint32_t version;
+    uint32_t vtoc_sz;
+    uint32_t entry_sz;
+    uint32_t pad;
+    struct mfsidx_key key;
+    uint64_t file_size;
+    int32_t vtoc_cnt;
+    int32_t total_vtoc_no;
+    int32_t vtoc_no [3];
+    uint32_t uid_hmask;
+    uint32_t path_hmask;
+    uint32_t pad2;
+    uint64_t vtoc_os;
+    uint64_t uid_hash_os;
+    uint64_t path_hash_os;
+    uint64_t extents_os;
+    uint32_t ext_cnt;
+    uint32_t pad3;
+  };
+
+static struct
+  {
+    struct mfsidx_key key;
+    uint8_t * base;
+    size_t size;
+  } sidecar;
+
+static char * sidecarName (struct m_state * m_data)
+  {
+    char * name = malloc (strlen (m_data -> dsknam) + sizeof (".mfsidx"));
+    if (name == NULL)
+      {
+        perror ("sidecar name alloc");
+        abort ();
+      }
+    strcpy (name, m_data -> dsknam);
+    strcat (name, ".mfsidx");
+    return name;
+  }
+
+// Output buffer; every piece starts on an 8 byte boundary
+
+struct obuf
+  {
+    uint8_t * p;
+    size_t len;
+    size_t cap;
+  };
+
+static uint64_t obufPut (struct obuf * b, const void * data, size_t len)
+  {
+    size_t os = (b -> len + 7) & ~(size_t) 7;
+    while (os + len > b -> cap)
+      {
+        b -> cap = b -> cap ? b -> cap * 2 : 1 << 20;
+        b -> p = realloc (b -> p, b -> cap);
+        if (b -> p == NULL)
+          {
+            perror ("sidecar buffer alloc");
+            abort ();
+          }
+      }
+    memset (b -> p + b -> len, 0, os - b -> len);
+    memcpy (b -> p + os, data, len);
+    b -> len = os + len;
+    return os;
+  }
+
+// The arena goes out block by block, so shared strings stay shared;
+// a pointer into it becomes the offset of the same byte in the file
+
+static int blockCmp (const void * a, const void * b)
+  {
+    const struct ablock * x = * (struct ablock * const *) a;
+    const struct ablock * y = * (struct ablock * const *) b;
+    return x < y ? -1 : x > y;
+  }
+
+static void * arenaOffset (struct ablock * * blks, uint nblk, const void * p)
+  {
+    if (! p)
+      return NULL;
+    const uint8_t * q = p;
+    uint lo = 0, hi = nblk;
+    while (lo < hi)
+      {
+        uint mid = (lo + hi) / 2;
+        if (q < blks [mid] -> data)
+          hi = mid;
+        else if (q > blks [mid] -> data + blks [mid] -> used)
+          lo = mid + 1;
+        else
+          return (void *) (uintptr_t) (blks [mid] -> os + (q - blks [mid] -> data));
+      }
+    fprintf (stderr, "saveIndex: pointer outside the arena\n");
+    abort ();
+  }
+
+static void saveIndex (struct m_state * m_data)
+  {
+    struct obuf b = { NULL, 0, 0 };
+    struct mfsidx_hdr hdr;
+    memset (& hdr, 0, sizeof (hdr));
+    obufPut (& b, & hdr, sizeof (hdr));
+
+    uint64_t vtoc_os = obufPut (& b, m_data -> vtoc, m_data -> vtoc_cnt * sizeof (struct vtoc));
+    uint64_t uid_hash_os = obufPut (& b, m_data -> uid_hash, (m_data -> uid_hmask + 1) * sizeof (int));
+    uint64_t path_hash_os = obufPut (& b, m_data -> path_hash, (m_data -> path_hmask + 1) * sizeof (int));
+    uint64_t extents_os = obufPut (& b, m_data -> extents, m_data -> ext_cnt * sizeof (struct extent));
+
+    // Every directory has been parsed, so the arena is done growing
+    pthread_mutex_lock (& arena . lock);
+    uint nblk = arena . nblocks;
+    struct ablock * blks [nblk ? nblk : 1];
+    uint k = 0;
+    for (struct ablock * a = arena . head; a; a = a -> next)
+      {
+        a -> os = obufPut (& b, a -> data, a -> used);
+        blks [k ++] = a;
+      }
+    pthread_mutex_unlock (& arena . lock);
+    qsort (blks, nblk, sizeof (blks [0]), blockCmp);
+
+    for (int i = 0; i < m_data -> vtoc_cnt; i ++)
+      {
+        struct vtoc v = m_data -> vtoc [i];
+        v . name = arenaOffset (blks, nblk, v . name);
+        v . dir = arenaOffset (blks, nblk, v . dir);
+        v . entries = arenaOffset (blks, nblk, v . entries);
+        if (v . entries)
+          {
+            struct entry * e = (struct entry *) (b . p + (uintptr_t) v . entries);
+            for (int j = 0; j < v . ent_cnt; j ++)
+              {
+                e [j] . name = arenaOffset (blks, nblk, e [j] . name);
+                e [j] . link_target = arenaOffset (blks, nblk, e [j] . link_target);
+              }
+          }
+        v . ent_hash = arenaOffset (blks, nblk, v . ent_hash);
+        v . parsed = 1;
+        memset (& v . dir_lock, 0, sizeof (v . dir_lock));
+        memcpy (b . p + vtoc_os + i * sizeof (struct vtoc), & v, sizeof (struct vtoc));
+      }
+    // Strings found in bounds are terminated by the end of the file
+    obufPut (& b, "", 1);
+
+    memcpy (hdr . magic, MFSIDX_MAGIC, sizeof (hdr . magic));
+    hdr . version = MFSIDX_VERSION;
+    hdr . vtoc_sz = sizeof (struct vtoc);
+    hdr . entry_sz = sizeof (struct entry);
+    hdr . key = sidecar . key;
+    hdr . file_size = b . len;
+    hdr . vtoc_cnt = m_data -> vtoc_cnt;
+    hdr . total_vtoc_no = m_data -> total_vtoc_no;
+    memcpy (hdr . vtoc_no, m_data -> vtoc_no, sizeof (hdr . vtoc_no));
+    hdr . uid_hmask = m_data -> uid_hmask;
+    hdr . path_hmask = m_data -> path_hmask;
+    hdr . vtoc_os = vtoc_os;
+    hdr . uid_hash_os = uid_hash_os;
+    hdr . path_hash_os = path_hash_os;
+    hdr . extents_os = extents_os;
+    hdr . ext_cnt = m_data -> ext_cnt;
+    memcpy (b . p, & hdr, sizeof (hdr));
+
+    // Write a temporary and rename it, so a reader never sees half a file
+    char * name = sidecarName (m_data);
+    char tmp [strlen (name) + 5];
+    strcpy (tmp, name);
+    strcat (tmp, ".tmp");
+    int fd = open (tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 ||
+        write (fd, b . p, b . len) != (ssize_t) b . len ||
+        close (fd) < 0 ||
+        rename (tmp, name) < 0)
+      {
+        fprintf (stderr, "WARNING: can't write index %s: %s\n", name, strerror (errno));
+        unlink (tmp);
+      }
+    free (name);
+    free (b . p);
+  }
+
+// Turn a stored offset back into a pointer; NULL stays NULL, anything
+// out of bounds fails the load
+
+static void * reloc (void * os, size_t len, int * bad)
+  {
+    uint64_t o = (uintptr_t) os;
+    if (! o)
+      return NULL;
+    if (o < sizeof (struct mfsidx_hdr) || o > sidecar . size || len > sidecar . size - o)
+      {
+        * bad = 1;
+        return NULL;
+      }
+    return sidecar . base + o;
+  }
+
+// A hash table as the build functions make them: the smallest power of
+// two, at least min, holding twice cnt slots; every slot empty or an
+// index below cnt, and at least one slot empty so that a probe for a
+// missing key ends
+
+static int hashOk (const int * hash, uint hmask, uint min, int cnt)
+  {
+    uint nhash = min;
+    while (nhash < 2 * (uint) cnt)
+      nhash <<= 1;
+    if (hmask + 1ul != nhash)
+      return 0;
+    int empty = 0;
+    for (uint i = 0; i <= hmask; i ++)
+      if (hash [i] == -1)
+        empty = 1;
+      else if (hash [i] < 0 || hash [i] >= cnt)
+        return 0;
+    return empty;
+  }
+
+// return
+//   0 tables loaded
+//  -1 no usable sidecar
+
+static int loadIndex (struct m_state * m_data)
+  {
+    char * name = sidecarName (m_data);
+    int fd = open (name, O_RDONLY);
+    free (name);
+    if (fd < 0)
+      return -1;
+    struct stat st;
+    struct mfsidx_hdr hdr;
+    if (fstat (fd, & st) < 0 ||
+        (size_t) st . st_size < sizeof (hdr) ||
+        pread (fd, & hdr, sizeof (hdr), 0) != sizeof (hdr) ||
+        memcmp (hdr . magic, MFSIDX_MAGIC, sizeof (hdr . magic)) != 0 ||
+        hdr . version != MFSIDX_VERSION ||
+        hdr . vtoc_sz != sizeof (struct vtoc) ||
+        hdr . entry_sz != sizeof (struct entry) ||
+        memcmp (& hdr . key, & sidecar . key, sizeof (hdr . key)) != 0 ||
+        hdr . file_size != (uint64_t) st . st_size ||
+        hdr . total_vtoc_no != m_data -> total_vtoc_no ||
+        hdr . vtoc_cnt < 0 || hdr . vtoc_cnt > hdr . total_vtoc_no)
+      {
+        close (fd);
+        return -1;
+      }
+
+    sidecar . size = st . st_size;
+    sidecar . base = mmap (NULL, sidecar . size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close (fd);
+    if (sidecar . base == MAP_FAILED)
+      {
+        sidecar . base = NULL;
+        return -1;
+      }
+
+    int bad = sidecar . base [sidecar . size - 1] != 0;
+    struct vtoc * vtoc = reloc ((void *) (uintptr_t) hdr . vtoc_os, hdr . vtoc_cnt * sizeof (struct vtoc), & bad);
+    int * uid_hash = reloc ((void *) (uintptr_t) hdr . uid_hash_os, (hdr . uid_hmask + 1ul) * sizeof (int), & bad);
+    int * path_hash = reloc ((void *) (uintptr_t) hdr . path_hash_os, (hdr . path_hmask + 1ul) * sizeof (int), & bad);
+    struct extent * extents = reloc ((void *) (uintptr_t) hdr . extents_os, hdr . ext_cnt * sizeof (struct extent), & bad);
+    if ((hdr . vtoc_cnt && ! vtoc) || (hdr . ext_cnt && ! extents))
+      bad = 1;
+    for (uint x = 0; ! bad && x < hdr . ext_cnt; x ++)
+      if (extents [x] . rec + extents [x] . nrec > 0400000 ||
+          extents [x] . frec + extents [x] . nrec > 256)
+        bad = 1;
+    for (int i = 0; ! bad && i < hdr . vtoc_cnt; i ++)
+      {
+        struct vtoc * v = vtoc + i;
+        v -> name = reloc (v -> name, 1, & bad);
+        v -> dir = reloc (v -> dir, 1, & bad);
+        if (v -> ent_cnt < 0)
+          bad = 1;
+        else
+          v -> entries = reloc (v -> entries, v -> ent_cnt * sizeof (struct entry), & bad);
+        if (v -> ent_cnt && ! v -> entries)
+          bad = 1;
+        v -> ent_hash = reloc (v -> ent_hash, (v -> ent_hmask + 1ul) * sizeof (int), & bad);
+        for (int j = 0; ! bad && v -> entries && j < v -> ent_cnt; j ++)
           {
-dprintf (stderr, "processDirectory 8\n");
-            word18 pathname_size = readFileDataWord36 (m_data, ind, entryp + 24) & MASK18;
-            if (pathname_size > 168)
-              {
-                printf ("pathname_size %u truncated\n", pathname_size);
-                pathname_size = 168;
-              }
-            char pathname [169];
-            pathname [0] = 0;
-            for (int j = 0; j < 42; j ++)
-              strcat (pathname, str (readFileDataWord36 (m_data, ind, entryp + 25 + j)));
-            pathname [pathname_size] = 0;
-            //printf ("[%s]\n", pathname);
-            vtocp -> entries [entry_cnt] . link_target = strdup (pathname);
-dprintf (stderr, "processDirectory 8a entry %d path '%s'\n", entry_cnt, pathname);
+            v -> entries [j] . name = reloc (v -> entries [j] . name, 1, & bad);
+            v -> entries [j] . link_target = reloc (v -> entries [j] . link_target, 1, & bad);
           }
-        else
+        for (int j = 0; ! bad && v -> entries && j < v -> ent_cnt; j ++)
           {
-dprintf (stderr, "processDirectory 9\n");
-            char path [8192];
-            strcpy (path, vtocp -> fq_name);
-            if (strcmp (path, ">") != 0)
-              strcat (path, ">");
-            strcat (path, name);
-            unfixit (path);
-            vtocp -> entries [entry_cnt] . pri_ind = mx_lookup_path (m_data, path);
-dprintf (stderr, "processDirectory 9a entry %d path '%s'\n", entry_cnt, path);
+            struct entry * e = v -> entries + j;
+            if (! e -> name || (e -> type == 5 && ! e -> link_target) ||
+                e -> pri_ind < -1 || e -> pri_ind >= hdr . vtoc_cnt)
+              bad = 1;
           }
-        entry_cnt ++;
-next:;
-        entryp = efrp;
+        if (! bad && v -> ent_hash && ! hashOk (v -> ent_hash, v -> ent_hmask, 4, v -> ent_cnt))
+          bad = 1;
+        if (! v -> name || ! v -> dir || v -> sv < 0 || v -> sv > 2 ||
+            (uint64_t) v -> ext_os + v -> ext_cnt > hdr . ext_cnt)
+          bad = 1;
+        pthread_mutex_init (& v -> dir_lock, NULL);
       }
-dprintf (stderr, "processDirectory 10\n");
-    if (entry_cnt != vtocp -> ent_cnt)
-      printf ("entry_cnt %d ent_cnt %d\n", entry_cnt, vtocp -> ent_cnt);
+    if (bad || ! vtoc || ! uid_hash || ! path_hash ||
+        ! hashOk (uid_hash, hdr . uid_hmask, 16, hdr . vtoc_cnt) ||
+        ! hashOk (path_hash, hdr . path_hmask, 16, hdr . vtoc_cnt))
+      {
+        fprintf (stderr, "WARNING: index sidecar is damaged; rebuilding\n");
+        munmap (sidecar . base, sidecar . size);
+        sidecar . base = NULL;
+        return -1;
+      }
+
+    free (m_data -> vtoc);
+    m_data -> vtoc = vtoc;
+    m_data -> vtoc_cnt = hdr . vtoc_cnt;
+    m_data -> uid_hash = uid_hash;
+    m_data -> uid_hmask = hdr . uid_hmask;
+    m_data -> path_hash = path_hash;
+    m_data -> path_hmask = hdr . path_hmask;
+    m_data -> extents = extents;
+    m_data -> ext_cnt = hdr . ext_cnt;
+    buildUids (m_data);
+    return 0;
+  }
+
+// Report the memory held by the tables; the arena holds the names and
+// the entries of the directories parsed so far
+
+static void reportIndex (struct m_state * m_data)
+  {
+    if (sidecar . base)
+      {
+        fprintf (stderr, "index: %d VTOCEs, %zu bytes mapped from the sidecar\n",
+                 m_data -> vtoc_cnt, sidecar . size);
+        return;
+      }
+    size_t vtoc_sz = m_data -> vtoc_cnt * (sizeof (struct vtoc) + sizeof (word36));
+    size_t fm_sz = m_data -> ext_cnt * sizeof (struct extent);
+    size_t hash_sz = (m_data -> uid_hmask + 1ul + m_data -> path_hmask + 1ul) * sizeof (int);
+    uint nstr = internCount ();
+    pthread_mutex_lock (& arena . lock);
+    size_t arena_sz = arena . used;
+    uint nblk = arena . nblocks;
+    pthread_mutex_unlock (& arena . lock);
+    fprintf (stderr, "index: %d VTOCEs, %zu bytes: vtoc %zu, file maps %zu (%u extents), "
+             "hashes %zu, arena %zu in %u blocks (%u strings interned)\n",
+             m_data -> vtoc_cnt, vtoc_sz + fm_sz + hash_sz + arena_sz,
+             vtoc_sz, fm_sz, m_data -> ext_cnt, hash_sz, arena_sz, nblk, nstr);
+  }
+
+// Background indexer
+//
+//   mx_mount only checks the label and sizes the VTOC; the tables are
+//   built by an indexer thread, so FUSE can start serving at once.
+//   Path lookups wait until the VTOC, name and index tables are ready.
+//   Directories are parsed on first use; with -o eager the indexer then
+//   goes on to parse them all, and a request for a directory it hasn't
+//   reached yet simply parses that one itself.
+//
+//   fuse_main forks, so the thread is started from the init op via
+//   mx_start_index, or else by the first lookup.
+
+static struct
+  {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    pthread_t tid;
+    int started;
+    int ready;
+  } idx = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0, 0, 0 };
+
+static void setReady (void)
+  {
+    pthread_mutex_lock (& idx . lock);
+    __atomic_store_n (& idx . ready, 1, __ATOMIC_RELEASE);
+    pthread_cond_broadcast (& idx . cond);
+    pthread_mutex_unlock (& idx . lock);
+  }
+
+static void * indexer (void * arg)
+  {
+    struct m_state * m_data = arg;
+
+// Build uid, attr and name table
+
+    m_data -> vtoc_cnt = 0;
+    struct ancestry * anc = malloc (m_data -> total_vtoc_no * sizeof (struct ancestry));
+    if (anc == NULL)
+      {
+        perror ("ancestry alloc");
+        abort ();
+      }
+    char root_pname [33] = "";
+    // Chunks on one subvolume may be fetched all at once, into the same
+    // cache shard, so between them they must fit in one batch or they
+    // evict each other before they are scanned
+    int chunk_ents = 2 * batchLimit ();
+    if (! image . base)
+      chunk_ents = 2 * (batchLimit () / m_data -> threads);
+    if (chunk_ents < 2)
+      chunk_ents = 2;
+    uint nchunks = 0;
+    for (int sv = 0; sv < 3; sv ++)
+      nchunks += (m_data -> vtoc_no [sv] + chunk_ents - 1) / chunk_ents;
+    struct vchunk * chunks = calloc (nchunks, sizeof (struct vchunk));
+    if (chunks == NULL && nchunks)
+      {
+        perror ("vtoc chunks alloc");
+        abort ();
+      }
+    uint ci = 0;
+    for (int sv = 0; sv < 3; sv ++)
+      for (int i = 0; i < m_data -> vtoc_no [sv]; i += chunk_ents)
+        {
+          chunks [ci] . sv = sv;
+          chunks [ci] . first = i;
+          chunks [ci] . nent = m_data -> vtoc_no [sv] - i < chunk_ents ?
+                               m_data -> vtoc_no [sv] - i : chunk_ents;
+          ci ++;
+        }
+
+    struct vscan vs = { m_data, chunks };
+    runPool (m_data -> threads, nchunks, scanChunk, & vs);
+
+    uint ext_cnt = 0;
+    for (ci = 0; ci < nchunks; ci ++)
+      ext_cnt += chunks [ci] . ext . cnt;
+    m_data -> extents = malloc ((ext_cnt ? ext_cnt : 1) * sizeof (struct extent));
+    if (m_data -> extents == NULL)
+      {
+        perror ("extents alloc");
+        abort ();
+      }
+    m_data -> ext_cnt = 0;
+    for (ci = 0; ci < nchunks; ci ++)
+      {
+        struct vchunk * ch = chunks + ci;
+        for (int i = 0; i < ch -> cnt; i ++)
+          ch -> vtoc [i] . ext_os += m_data -> ext_cnt;
+        memcpy (m_data -> vtoc + m_data -> vtoc_cnt, ch -> vtoc, ch -> cnt * sizeof (struct vtoc));
+        memcpy (anc + m_data -> vtoc_cnt, ch -> anc, ch -> cnt * sizeof (struct ancestry));
+        memcpy (m_data -> extents + m_data -> ext_cnt, ch -> ext . p, ch -> ext . cnt * sizeof (struct extent));
+        m_data -> vtoc_cnt += ch -> cnt;
+        m_data -> ext_cnt += ch -> ext . cnt;
+        if (ch -> has_root)
+          strcpy (root_pname, ch -> root_pname);
+        free (ch -> vtoc);
+        free (ch -> anc);
+        free (ch -> ext . p);
+      }
+    free (chunks);
+    for (int i = 0; i < m_data -> vtoc_cnt; i ++)
+      pthread_mutex_init (& m_data -> vtoc [i] . dir_lock, NULL);
+
+#ifdef TIME_VTOC
+    timeVTOCDecode (m_data);
+#endif
+dprintf (stderr, "mx_mount 7\n");
+    buildUidIndex (m_data);
+
+// Build the directory paths
+
+    for (int i = 0; i < m_data -> vtoc_cnt; i ++)
+      {
+dprintf (stderr, "mx_mount 8\n");
+        buildDir (m_data, anc, i, root_pname);
+dprintf (stderr, "mx_mount 8 dir: '%s' name: '%s'\n", m_data -> vtoc [i] . dir, m_data -> vtoc [i] . name);
+      }
+    free (anc);
+
+    buildPathIndex (m_data);
+
+    setReady ();
+
+// Build directory entries; all of them if the result is to be saved
+
+    if (! m_data -> eager && m_data -> noindex)
+      {
+        reportIndex (m_data);
+        return NULL;
+      }
+dprintf (stderr, "mx_mount 9\n");
+    struct dscan ds = { m_data, malloc (m_data -> vtoc_cnt * sizeof (int)), 0 };
+    if (ds . dirs == NULL && m_data -> vtoc_cnt)
+      {
+        perror ("dir list alloc");
+        abort ();
+      }
+    for (int i = 0; i < m_data -> vtoc_cnt; i ++)
+      if (m_data -> vtoc [i] . attr & 0400000)
+        ds . dirs [ds . ndirs ++] = i;
+    runPool (m_data -> threads, ds . ndirs, scanDirectory, & ds);
+    free (ds . dirs);
+
+    if (! m_data -> noindex)
+      saveIndex (m_data);
+    reportIndex (m_data);
+
+dprintf (stderr, "mx_mount 11\n");
+    return NULL;
+  }
+
+void mx_start_index (struct m_state * m_data)
+  {
+    pthread_mutex_lock (& idx . lock);
+    if (! idx . started && ! idx . ready)
+      {
+        if (pthread_create (& idx . tid, NULL, indexer, m_data))
+          {
+            perror ("indexer create");
+            abort ();
+          }
+        idx . started = 1;
+      }
+    pthread_mutex_unlock (& idx . lock);
+  }
+
+static void waitIndex (struct m_state * m_data)
+  {
+    if (__atomic_load_n (& idx . ready, __ATOMIC_ACQUIRE))
+      return;
+    mx_start_index (m_data);
+    pthread_mutex_lock (& idx . lock);
+    while (! idx . ready)
+      pthread_cond_wait (& idx . cond, & idx . lock);
+    pthread_mutex_unlock (& idx . lock);
   }
 
 // return
@@ -1091,19 +3414,60 @@ dprintf (stderr, "processDirectory 10\n");
 
 int mx_mount (struct m_state * m_data)
   {
-    m_data -> fd = open (m_data -> dsknam, O_RDONLY);
+    if (m_data -> direct && m_data -> use_mmap)
+      {
+        fprintf (stderr, "-o direct and -o mmap are mutually exclusive\n");
+        return -1;
+      }
+    if (m_data -> threads == 0)
+      {
+        long ncpu = sysconf (_SC_NPROCESSORS_ONLN);
+        m_data -> threads = ncpu > 0 ? ncpu : 1;
+      }
+    // runPool keeps its per-thread state on the stack
+    if (m_data -> threads > MAX_THREADS)
+      m_data -> threads = MAX_THREADS;
+    m_data -> fd = open (m_data -> dsknam, O_RDONLY | (m_data -> direct ? O_DIRECT : 0));
     if (m_data -> fd < 0)
       return -1;
+    if (m_data -> direct)
+      dioInit ();
+
+    if (m_data -> use_mmap)
+      {
+        if (mapImage (m_data -> fd) < 0)
+          {
+            perror ("mmap");
+            return -1;
+          }
+      }
+    else
+      cacheInit ((size_t) m_data -> cache_mb << 20);
+
+    if (m_data -> use_uring && m_data -> direct)
+      fprintf (stderr, "WARNING: -o uring is ignored with -o direct\n");
+    else if (m_data -> use_uring)
+      {
+#ifdef HAVE_LIBURING
+        int rc = io_uring_queue_init (URING_DEPTH, & ring, 0);
+        if (rc < 0)
+          fprintf (stderr, "io_uring_queue_init: %s\n", strerror (-rc));
+        else
+          ring_ok = 1;
+#else
+        fprintf (stderr, "WARNING: built without io_uring support\n");
+#endif
+      }
 
 #ifdef DEBUG
 // print pvids
 
     {
-      record r0;
+      char sbuf [5];
       for (int sv = 0; sv < 3; sv ++)
         { 
-          memset (& r0, 0, sizeof (record));
-          readRecord (m_data -> fd, 0, sv, & r0);
+          struct cent * pin;
+          const uint8_t * r0 = getRecord (m_data -> fd, 0, sv, & pin);
 
           int offset = label_perm_os;
           word36 w, w2;
@@ -1113,7 +3477,7 @@ int mx_mount (struct m_state * m_data)
           for (uint i = 0; i < 8; i++)
             {
               w = extr36 (r0, offset++);
-              dprintf (stderr, "%s", str (w));
+              dprintf (stderr, "%s", str (w, sbuf));
             }
           dprintf (stderr, "\n");
 
@@ -1124,7 +3488,7 @@ int mx_mount (struct m_state * m_data)
           for (uint i = 0; i < 8; i++)
             {
               w = extr36 (r0, offset++);
-              dprintf (stderr, "%s", str (w));
+              dprintf (stderr, "%s", str (w, sbuf));
             }
           dprintf (stderr, "\n");
 
@@ -1132,7 +3496,7 @@ int mx_mount (struct m_state * m_data)
           for (uint i = 0; i < 8; i++)
             {
               w = extr36 (r0, offset++);
-              dprintf (stderr, "%s", str (w));
+              dprintf (stderr, "%s", str (w, sbuf));
             }
           dprintf (stderr, "\n");
 
@@ -1140,7 +3504,7 @@ int mx_mount (struct m_state * m_data)
           for (uint i = 0; i < 8; i++)
             {
               w = extr36 (r0, offset++);
-              dprintf (stderr, "%s", str (w));
+              dprintf (stderr, "%s", str (w, sbuf));
             }
           dprintf (stderr, "\n");
 
@@ -1159,6 +3523,7 @@ int mx_mount (struct m_state * m_data)
 
           w = extr36 (r0, offset++);
           dprintf (stderr, "  number of PVs in LV: %ld\n", w);
+          putRecord (pin);
 
 
         }
@@ -1168,13 +3533,14 @@ int mx_mount (struct m_state * m_data)
 // Get the disk label; verify that it is a Multics volume
 
     record r0;
-    memset (& r0, 0, sizeof (record));
-    readRecord (m_data -> fd, 0, 0, & r0);
+    struct cent * pin;
+    memcpy (r0, getRecord (m_data -> fd, 0, 0, & pin), sizeof (record));
+    putRecord (pin);
 #if 0
     for (int i = 0; i < 1024; i ++)
       {
         word36 w = extr36 (r0, i);
-        fprintf (stderr, "012lo %s\n", w, str (w));
+        fprintf (stderr, "012lo %s\n", w, str (w, sbuf));
       }
 #endif
 // Identifer is Multics char (32) init ("Multics Storage System Volume")
@@ -1218,6 +3584,16 @@ dprintf (stderr, "mx_mount 2\n");
     word36 time_map_upd = extr36 (r0, label_time_map_updated_os);
     word36 time_unmounted = extr36 (r0, label_time_unmounted_os);
 
+    struct stat st;
+    if (fstat (m_data -> fd, & st) == 0)
+      {
+        sidecar . key . image_size = st . st_size;
+        sidecar . key . mtime_sec = st . st_mtim . tv_sec;
+        sidecar . key . mtime_nsec = st . st_mtim . tv_nsec;
+      }
+    sidecar . key . time_map_upd = time_map_upd;
+    sidecar . key . time_unmounted = time_unmounted;
+
     dprintf (stderr, "Time map updated %012lo\n", time_map_upd);
     dprintf (stderr, "Time unmounted   %012lo\n", time_unmounted);
 
@@ -1252,7 +3628,7 @@ dprintf (stderr, "mx_mount 2\n");
     for (int i = label_root_os; i < label_root_os + 20; i ++)
       {
         word36 w = extr36 (r0, i);
-        fprintf (stderr, "012lo %s\n", w, str (w));
+        fprintf (stderr, "012lo %s\n", w, str (w, sbuf));
       }
 #else
     vtoc_origin = 8;
@@ -1264,18 +3640,17 @@ dprintf (stderr, "mx_mount 3\n");
     for (int sv = 0; sv < 3; sv ++)
       {
 dprintf (stderr, "mx_mount 4\n");
-        record vtoch;
-        memset (& vtoch, 0, sizeof (record));
-        readRecord (m_data -> fd, vtoc_header, sv, & vtoch);
+        const uint8_t * vtoch = getRecord (m_data -> fd, vtoc_header, sv, & pin);
         //word36 n_vtoces = extr36 (vtoch, vtoc_header_n_vtoce_os);
         //dprintf (stderr, "n_vtoces %lu\n", n_vtoces);
         //word36 n_free_vtoces = extr36 (vtoch, vtoc_header_n_free_vtoce);
         word36 vtoc_last_recno = extr36 (vtoch, vtoc_header_vtoc_last_recno);
+        putRecord (pin);
     
         word36 vtoc_sz_recs = vtoc_last_recno + 1 - vtoc_origin;
         m_data ->  vtoc_no [sv] = (int) (vtoc_sz_recs * 2);
         m_data -> total_vtoc_no += m_data ->  vtoc_no [sv];
-        dprintf (stderr, "vtoc_no %lu\n", vtoc_no);
+        dprintf (stderr, "vtoc_no %d\n", m_data -> vtoc_no [sv]);
       }
 
 dprintf (stderr, "mx_mount 5\n");
@@ -1286,148 +3661,229 @@ dprintf (stderr, "mx_mount 5\n");
         abort ();
       }
 
-// Build uid, attr and name table
+    if (! m_data -> noindex && loadIndex (m_data) == 0)
+      {
+        setReady ();
+        reportIndex (m_data);
+      }
 
-    m_data -> vtoc_cnt = 0;
-    for (int sv = 0; sv < 3; sv ++)
+    return 0;
+  }
+
+void mx_unmount (struct m_state * m_data)
+  {
+    if (idx . started)
+      pthread_join (idx . tid, NULL);
+    if (image . base)
+      munmap (image . base, image . size);
+    else
+      for (int sv = 0; sv < number_of_sv; sv ++)
+        fprintf (stderr, "record cache %c: %u records, %lu hits, %lu misses\n",
+                 'a' + sv, cache [sv] . nslots, cache [sv] . hits, cache [sv] . misses);
+#ifdef HAVE_LIBURING
+    if (ring_ok)
+      io_uring_queue_exit (& ring);
+#endif
+    free (m_data -> uids);
+    if (sidecar . base)
+      munmap (sidecar . base, sidecar . size);
+    else
       {
-dprintf (stderr, "mx_mount 6\n");
-        for (int i = 0; i < m_data -> vtoc_no [sv]; i ++)
-          {
-            VTOCE vtoce;
-            readVTOCE (m_data -> fd, i, sv, & vtoce);
-            word36 uid = vtoce [1];
-            if (! uid)
-              continue;
-            m_data -> vtoc [m_data -> vtoc_cnt] . uid = uid;
-            m_data -> vtoc [m_data -> vtoc_cnt] . attr = vtoce [5];
-            m_data -> vtoc [m_data -> vtoc_cnt] . dtu = vtoce [3];
-            m_data -> vtoc [m_data -> vtoc_cnt] . dtm = vtoce [4];
-            m_data -> vtoc [m_data -> vtoc_cnt] . time_created = vtoce [184];
-            m_data -> vtoc [m_data -> vtoc_cnt] . sv = sv;
-            m_data -> vtoc [m_data -> vtoc_cnt] . vtoce= i;
-            for (uint fmi = 0; fmi < 128; fmi ++)
-              {
-                m_data -> vtoc [m_data -> vtoc_cnt] . filemap [fmi * 2] = (vtoce [vtoce_fm_os + fmi] >> 18) & MASK18;
-                m_data -> vtoc [m_data -> vtoc_cnt] . filemap [fmi * 2 + 1] = vtoce [vtoce_fm_os + fmi] & MASK18;
-              }
+        free (m_data -> uid_hash);
+        free (m_data -> path_hash);
+        free (m_data -> extents);
+      }
+    arenaFree ();
+    internFree ();
+    close (m_data -> fd);
+  }
 
-            if (uid == 0777777777777lu) // root
-              {
-                m_data -> vtoc [m_data -> vtoc_cnt] . name = strdup (">");
-              }
-            else
-              {
-                char name [33 + 100];
-                name [0] = 0;
-                for (int j = 0; j < 8; j ++)
-                   strcat (name, str (vtoce [vtoce_primary_name_os + j]));
-                for (int j = strlen (name) - 1; j >= 0; j --)
-                   if (name [j] == ' ')
-                     name [j] = 0;
-                   else
-                     break;
-                m_data -> vtoc [m_data -> vtoc_cnt] .name = strdup (name);
-dprintf (stderr, "mx_mount 6 name: '%s'\n", name);
-              }
-            m_data -> vtoc_cnt ++;
-          }
+// Number of 512 byte blocks actually allocated to the first size bytes
+// of a segment; unallocated records don't count, so sparse-aware tools
+// can tell that a segment has holes.
+
+long mx_blocks (struct m_state * m_data, int ind, off_t size)
+  {
+    uint nrecs = (size + RECORD_SZ_IN_BYTES - 1) / RECORD_SZ_IN_BYTES;
+    if (nrecs > 256)
+      nrecs = 256;
+    long blocks = 0;
+    struct vtoc * vtocp = m_data -> vtoc + ind;
+    const struct extent * e = m_data -> extents + vtocp -> ext_os;
+    for (uint x = 0; x < vtocp -> ext_cnt && e [x] . frec < nrecs; x ++)
+      {
+        uint n = e [x] . frec + e [x] . nrec > nrecs ? nrecs - e [x] . frec : e [x] . nrec;
+        blocks += n * (RECORD_SZ_IN_BYTES / 512);
       }
+    return blocks;
+  }
 
-dprintf (stderr, "mx_mount 7\n");
+static int lookupPath (struct m_state * m_data, const char * path, size_t len)
+  {
+    uint h = pathHash (path, len, m_data -> path_hmask);
+    int i;
+    while ((i = m_data -> path_hash [h]) >= 0)
+      {
+//log_msg ("%s %s%s\n", path, m_data -> vtoc [i] . dir, m_data -> vtoc [i] . name);
+        if (pathEq (m_data -> vtoc + i, path, len))
+          return i;
+        h = (h + 1) & m_data -> path_hmask;
+      }
+    return -1;
+  }
 
-// Build dir_name & fq_name table
+// return index into uid table; -1 if no such file or directory
+int mx_lookup_path (struct m_state * m_data , const char * path)
+  {
+    if (path [0] != '/')
+      {
+        //log_msg ("mx_lookup_path not at root (%s)\n", path);
+        return -1;
+      }
+    waitIndex (m_data);
+    return lookupPath (m_data, path, strlen (path));
+  }
 
-    for (int i = 0; i < m_data -> vtoc_cnt; i ++)
+// Resolve a path to its parent directory, its entry in that directory
+// and its vtoc index, in one pass over the path and without copying it.
+//
+// return
+//   0 ok
+//     * dindp  parent directory
+//     * eindp  entry in the parent; -1 for the root, or for a directory
+//              not listed in its parent
+//     * indp   vtoc index; -1 for links and for segments whose uid
+//              isn't on this volume
+//   -ENOENT no such file or directory
+
+int mx_resolve (struct m_state * m_data, const char * path, int * dindp, int * eindp, int * indp)
+  {
+    if (path [0] != '/')
+      return -ENOENT;
+    waitIndex (m_data);
+
+    const char * last = strrchr (path, '/');
+    size_t dlen = last == path ? 1 : (size_t) (last - path);
+    int dind = lookupPath (m_data, path, dlen);
+    if (dind < 0)
+      return -ENOENT;
+    if (! (m_data -> vtoc [dind] . attr & 0400000))
       {
-dprintf (stderr, "mx_mount 8\n");
-        char fq_name [4096];
-        fq_name [0] = 0;
+        printf ("mx_resolve dir not dir? [%s]\n", path);
+        return -ENOENT;
+      }
+    mx_load_dir (m_data, dind);
+    * dindp = dind;
 
-        VTOCE vtoce;
-        readVTOCE (m_data -> fd, m_data -> vtoc [i] . vtoce, m_data -> vtoc [i] . sv, & vtoce);
-        for (int j = 0; j < 16; j ++)
+    const char * basename = last + 1;
+    if (! * basename)
+      {
+        if (last != path)
           {
-            word36 path_uid = vtoce [160 + j];
-            if (! path_uid)
-              break;
-            int k;
-            for (k = 0; k < m_data -> vtoc_cnt; k ++)
-              {
-                if (m_data -> vtoc [k] . uid == path_uid)
-                  {
-                    strcat (fq_name, m_data -> vtoc [k] . name);
-                    break;
-                  }
-              }
-            if (k >= m_data -> vtoc_cnt)
-              {
-                 char buf [13];
-                 sprintf (buf, "%012lo", path_uid);
-                 strcat (fq_name, buf);
-              }
-            if (j)
-              strcat (fq_name, ">");
+            printf ("mx_resolve no basename but not dir in %s?\n", path);
+            return -ENOENT;
           }
-
-        m_data -> vtoc [i] . dir_name = strdup (fq_name);
-dprintf (stderr, "mx_mount 8 dir name: '%s'\n", fq_name);
-
-        char name [33];
-        name [0] = 0;
-        for (int j = 0; j < 8; j ++)
-          strcat (name, str (vtoce [vtoce_primary_name_os + j]));
-        for (int j = strlen (name) - 1; j >= 0; j --)
-          if (name [j] == ' ')
-            name [j] = 0;
-          else
-            break;
-        strcat (fq_name, name);
-        m_data -> vtoc [i] . fq_name = strdup (fq_name);
-dprintf (stderr, "mx_mount 8 fq name: '%s'\n", fq_name);
+        // only root
+        * eindp = -1;
+        * indp = dind;
+        return 0;
       }
 
-// Build directory entries
-
-dprintf (stderr, "mx_mount 9\n");
-    for (int i = 0; i < m_data -> vtoc_cnt; i ++)
+    struct entry * entryp = m_data -> vtoc [dind] . entries;
+    int eind = findEntry (m_data -> vtoc + dind, basename);
+    if (eind < 0)
       {
-dprintf (stderr, "mx_mount 10\n");
-        if (m_data -> vtoc [i] . attr & 0400000)
-          processDirectory (m_data, i);
+        int ind = lookupPath (m_data, path, strlen (path));
+        if (ind < 0 || ! (m_data -> vtoc [ind] . attr & 0400000))
+          return -ENOENT;
+        * eindp = -1;
+        * indp = ind;
+        return 0;
       }
 
-dprintf (stderr, "mx_mount 11\n");
+    * eindp = eind;
+    if (entryp [eind] . type == 5) // link
+      * indp = -1;
+    else
+      * indp = mx_find_uid (m_data, entryp [eind] . uid);
     return 0;
   }
 
 
-// return index into uid table; -1 if no such file or directory
-int mx_lookup_path (struct m_state * m_data , const char * path)
+// Queue the file records in the read-ahead window past lastrec that
+// haven't been asked for yet, as physically contiguous runs. Nothing is
+// queued until the reader has consumed half of the previous window.
+
+static void readAhead (struct m_state * m_data, struct m_file * filep, uint lastrec)
   {
-    if (path [0] != '/')
+    struct entry * entryp = filep -> entryp;
+    struct vtoc * vtocp = m_data -> vtoc + entryp -> pri_ind;
+    uint nrecs = ((entryp -> bitcnt + 7) / 8 + RECORD_SZ_IN_BYTES - 1) / RECORD_SZ_IN_BYTES;
+    if (nrecs > 256)
+      nrecs = 256;
+    uint from = lastrec + 1;
+    if (filep -> ra_next > from)
+      from = filep -> ra_next;
+    if (from - lastrec > m_data -> readahead / 2)
+      return;
+    uint to = lastrec + 1 + m_data -> readahead;
+    if (to > nrecs)
+      to = nrecs;
+    if (from >= to)
+      return;
+    filep -> ra_next = to;
+
+    for (uint f = from; f < to; )
       {
-        //log_msg ("mx_lookup_path not at root (%s)\n", path);
-        return -1;
+        uint first = fmRecord (m_data, vtocp, f);
+        if ((first & 0400000) || cacheResident (first, vtocp -> sv))
+          {
+            f ++;
+            continue;
+          }
+        int sect = r2s (first, vtocp -> sv);
+        uint n = 1;
+        while (f + n < to &&
+               ! (fmRecord (m_data, vtocp, f + n) & 0400000) &&
+               r2s (fmRecord (m_data, vtocp, f + n), vtocp -> sv) ==
+                 sect + (int) n * sect_per_rec)
+          n ++;
+dprintf (stderr, "readAhead frec %u rec %u n %u\n", f, first, n);
+        raQueue (m_data -> fd, first, vtocp -> sv, n);
+        f += n;
       }
-    char * s = strdup (path);
-    fixit (s);
-    for (int i = 0; i < m_data -> vtoc_cnt; i ++)
+  }
+
+// With -o text a segment reads as host text, one byte per 9 bit
+// character; each file record is transcoded straight out of the cache
+
+static int readText (struct m_state * m_data, int ind, char * buf, size_t size, off_t offset)
+  {
+    int writ = 0;
+    while (size)
       {
-//log_msg ("%s %s\n", s, m_data -> vtoc [i] . fq_name);
-        if (strcmp (s, m_data -> vtoc [i] . fq_name) == 0)
-          return i;
+        uint recno = offset / RECORD_SZ_IN_CHARS;
+        uint co = offset % RECORD_SZ_IN_CHARS;
+        uint mv = RECORD_SZ_IN_CHARS - co < size ? RECORD_SZ_IN_CHARS - co : size;
+        struct cent * pin;
+        const uint8_t * rdata = getFileDataRecord (m_data, ind, recno, & pin);
+        unpack9At (rdata, co, (uint8_t *) buf, mv);
+        putRecord (pin);
+        buf += mv;
+        size -= mv;
+        offset += mv;
+        writ += mv;
       }
-    return -1;
+    return writ;
   }
 
-
-int mx_read (char * buf, size_t size, off_t offset, struct entry * entryp)
+int mx_read (char * buf, size_t size, off_t offset, struct m_file * filep)
   {
 dprintf (stderr, "mx_read size %ld offset %ld\n", size, offset);
     struct m_state * m_data = M_DATA;
+    struct entry * entryp = filep -> entryp;
 
-    uint byte_cnt = (entryp -> bitcnt + 7) / 8;
+    uint byte_cnt = m_data -> text ? entryp -> bitcnt / 9 : (entryp -> bitcnt + 7) / 8;
 dprintf (stderr, "mx_read bitcnt %u byte_cnt %u\n", entryp -> bitcnt, byte_cnt);
     if (offset > byte_cnt)
       return 0;
@@ -1438,26 +3894,84 @@ dprintf (stderr, "mx_read bitcnt %u byte_cnt %u\n", entryp -> bitcnt, byte_cnt);
         size = byte_cnt - offset;
 dprintf (stderr, "size adjusted to %ld\n", size);
       }
+    struct vtoc * vtocp = m_data -> vtoc + entryp -> pri_ind;
     int writ = 0;
+    if (m_data -> text)
+      {
+        writ = readText (m_data, entryp -> pri_ind, buf, size, offset);
+        offset += writ;
+        size = 0;
+      }
     while (size)
       {
         off_t recno = offset / RECORD_SZ_IN_BYTES;
         off_t recos = offset % RECORD_SZ_IN_BYTES;
-        record rdata;
 dprintf (stderr, "recno %lu recos %lu\n", recno, recos);
-        readFileDataRecord (m_data, entryp -> pri_ind, recno, & rdata);
-        size_t residue = RECORD_SZ_IN_BYTES - recos;
+
+// Extend the run while the following file records are physically
+// adjacent on the subvolume. Records already in the cache (brought in
+// by read-ahead, say) are served from there instead. A run of
+// unallocated records is just zero filled.
+
+        uint nrec = 1;
+        uint first = fmRecord (m_data, vtocp, recno);
+        if (first & 0400000)
+          {
+            while (nrec * RECORD_SZ_IN_BYTES < recos + size &&
+                   recno + nrec < 256 &&
+                   (fmRecord (m_data, vtocp, recno + nrec) & 0400000))
+              nrec ++;
+          }
+        else if (! cacheResident (first, vtocp -> sv))
+          {
+            int sect = r2s (first, vtocp -> sv);
+            while (nrec * RECORD_SZ_IN_BYTES < recos + size &&
+                   recno + nrec < 256 &&
+                   ! (fmRecord (m_data, vtocp, recno + nrec) & 0400000) &&
+                   r2s (fmRecord (m_data, vtocp, recno + nrec), vtocp -> sv) ==
+                     sect + (int) nrec * sect_per_rec &&
+                   ! cacheResident (fmRecord (m_data, vtocp, recno + nrec), vtocp -> sv))
+              nrec ++;
+          }
+
+        size_t residue = nrec * RECORD_SZ_IN_BYTES - recos;
         uint mv;
         if (residue < size)
           mv = residue;
         else
           mv = size;
-        memcpy (buf, rdata + recos, mv);
+        if (first & 0400000)
+          memset (buf, 0, mv);
+        else if (nrec > 1)
+          readSpan (m_data -> fd, r2s (first, vtocp -> sv), recos, (uint8_t *) buf, mv);
+        else
+          {
+            struct cent * pin;
+            const uint8_t * rdata = getFileDataRecord (m_data, entryp -> pri_ind, recno, & pin);
+            memcpy (buf, rdata + recos, mv);
+            putRecord (pin);
+          }
         buf += mv;
         size -= mv;
         offset += mv;
         writ += mv;
       }
+
+// Sequential access detection
+
+    pthread_mutex_lock (& filep -> lock);
+    if (writ && offset - writ == filep -> next)
+      filep -> seq ++;
+    else
+      {
+        filep -> seq = 0;
+        filep -> ra_next = 0;
+      }
+    filep -> next = offset;
+    if (writ && filep -> seq >= 2 && m_data -> readahead)
+      readAhead (m_data, filep, (offset - 1) /
+                 (m_data -> text ? RECORD_SZ_IN_CHARS : RECORD_SZ_IN_BYTES));
+    pthread_mutex_unlock (& filep -> lock);
     return writ;
   }
 
@@ -1,4 +1,10 @@
 int mx_mount (struct m_state * state);
+void mx_unmount (struct m_state * state);
+void mx_start_index (struct m_state * state);
 int mx_lookup_path (struct m_state * state, const char * path);
+int mx_find_uid (struct m_state * state, word36 uid);
+void mx_load_dir (struct m_state * state, int ind);
+int mx_resolve (struct m_state * state, const char * path, int * dindp, int * eindp, int * indp);
 int mx_readdir (off_t offset, const char * path);
-int mx_read (char * buf, size_t size, off_t offset, struct entry * entryp);
+int mx_read (char * buf, size_t size, off_t offset, struct m_file * filep);
+long mx_blocks (struct m_state * state, int ind, off_t size);